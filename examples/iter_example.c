@@ -0,0 +1,40 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include "../src/autoclave_iter.h"
+
+/* A test that occasionally fails, and very occasionally crashes, so
+ * it can be run with e.g. `autoclave -N 1000 -f 5 build/iter_example`. */
+static bool test(size_t run_id) {
+    int v = rand() % 1000;
+    /* Print this, so there's some output in the logs */
+    printf("%zu: %d\n", run_id, v);
+    if (v == 1) {
+        abort();
+    }
+    return v > 5;
+}
+
+int main(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    srand(tv.tv_usec);
+
+    struct autoclave_iter it;
+    autoclave_iter_init(&it);
+    while (autoclave_iter_next(&it)) {
+        autoclave_iter_result(&it, test(it.run_id));
+    }
+    return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2015-18 Scott Vokes <vokes.s@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef AUTOCLAVE_ITER_H
+#define AUTOCLAVE_ITER_H
+
+/* Header-only client for autoclave's iteration protocol (-N), for C
+ * and C++ targets that can reset their own state between iterations,
+ * so one exec can serve many runs:
+ *
+ *     struct autoclave_iter it;
+ *     autoclave_iter_init(&it);
+ *     while (autoclave_iter_next(&it)) {
+ *         int ok = run_test(it.run_id);
+ *         autoclave_iter_result(&it, ok);
+ *     }
+ *
+ * If the target crashes or hangs partway through, autoclave attributes
+ * it to the iteration in progress. When not run by autoclave -N, the
+ * loop runs once, with a run_id of 0. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct autoclave_iter {
+    int control_fd;             /* -1 if not run by autoclave -N */
+    int report_fd;
+    size_t iterations;          /* the most autoclave may ask for */
+    size_t run_id;              /* current iteration's run ID */
+    size_t done;                /* iterations started so far */
+    size_t len;
+    char buf[64];
+};
+
+static inline int autoclave_iter_getenv_int_(const char *name, int def) {
+    const char *v = getenv(name);
+    return v != NULL && v[0] != '\0' ? atoi(v) : def;
+}
+
+static inline void autoclave_iter_init(struct autoclave_iter *it) {
+    memset(it, 0, sizeof(*it));
+    it->control_fd = autoclave_iter_getenv_int_("AUTOCLAVE_CONTROL_FD", -1);
+    it->report_fd = autoclave_iter_getenv_int_("AUTOCLAVE_REPORT_FD", -1);
+    it->iterations = (size_t)autoclave_iter_getenv_int_(
+        "AUTOCLAVE_ITERATIONS", 1);
+    if (it->control_fd == -1 || it->report_fd == -1) {
+        it->control_fd = -1;
+        it->report_fd = -1;
+        it->iterations = 1;
+    }
+}
+
+static inline void autoclave_iter_send_(struct autoclave_iter *it,
+    char type) {
+    char msg[32];
+    const int len = snprintf(msg, sizeof(msg), "%c %lu\n",
+        type, (unsigned long)it->run_id);
+    for (int used = 0; used < len; ) {
+        ssize_t wr = write(it->report_fd, &msg[used], len - used);
+        if (wr == -1) {
+            if (errno == EINTR) { continue; }
+            /* autoclave is gone. Unless the target ignores or handles
+             * SIGPIPE, it gets killed by it before getting here. */
+            return;
+        }
+        used += (int)wr;
+    }
+}
+
+/* Wait for autoclave to start the next iteration, and set it->run_id.
+ * Returns false once there are no more, and the target should exit. */
+static inline int autoclave_iter_next(struct autoclave_iter *it) {
+    if (it->control_fd == -1) { return it->done++ == 0; }
+
+    /* Read one "R <run_id>" line. */
+    it->len = 0;
+    for (;;) {
+        char c;
+        ssize_t rd = read(it->control_fd, &c, 1);
+        if (rd == -1 && errno == EINTR) { continue; }
+        if (rd <= 0) { return 0; }
+        if (c == '\n') { break; }
+        if (it->len < sizeof(it->buf) - 1) { it->buf[it->len++] = c; }
+    }
+    it->buf[it->len] = '\0';
+
+    unsigned long id;
+    if (1 != sscanf(it->buf, "R %lu", &id)) { return 0; }
+    it->run_id = (size_t)id;
+    it->done++;
+    autoclave_iter_send_(it, 'S');
+    return 1;
+}
+
+/* Report whether the current iteration passed. */
+static inline void autoclave_iter_result(struct autoclave_iter *it,
+    int passed) {
+    if (it->report_fd == -1) { return; }
+    autoclave_iter_send_(it, passed ? 'P' : 'F');
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2015-18 Scott Vokes <vokes.s@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "campaign.h"
+
+#define CAMPAIGN_MAGIC 0x61636c76 /* "aclv" */
+#define CAMPAIGN_VERSION 1
+
+/* Layout of the shared file. Once it is initialized, the header
+ * and limits are read-only and the counters are only updated with
+ * atomic operations, so no locks are needed. */
+struct campaign_segment {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t reserved;          /* zero; keeps the counters aligned */
+    uint32_t stop;
+    uint64_t max_runs;
+    uint64_t max_failures;
+    uint64_t next_run_id;
+    uint64_t runs_finished;
+    uint64_t failures;
+    uint64_t instances;
+    uint64_t instances_active;
+};
+
+struct campaign {
+    struct campaign_segment *seg;
+    pid_t owner;                /* the process that joined the campaign */
+};
+
+#define LOAD(P) __atomic_load_n(P, __ATOMIC_SEQ_CST)
+#define STORE(P, V) __atomic_store_n(P, V, __ATOMIC_SEQ_CST)
+#define INCR(P) __atomic_add_fetch(P, 1, __ATOMIC_SEQ_CST)
+
+static void lock_file(const char *path, int fd, short type) {
+    struct flock fl = {
+        .l_type = type,
+        .l_whence = SEEK_SET,
+    };
+    while (-1 == fcntl(fd, F_SETLKW, &fl)) {
+        if (errno != EINTR) { err(1, "fcntl: %s", path); }
+        errno = 0;
+    }
+}
+
+static void format_limit(char *buf, size_t size, uint64_t limit) {
+    if (limit == (uint64_t)SIZE_MAX) {
+        snprintf(buf, size, "none");
+    } else {
+        snprintf(buf, size, "%llu", (unsigned long long)limit);
+    }
+}
+
+/* An existing campaign keeps its own limits, and may be left over
+ * from an earlier invocation, so say when this instance's options
+ * won't apply, and refuse to join one that has already finished. */
+static void check_joined(const char *path, struct campaign *c,
+    size_t max_runs, size_t max_failures) {
+    struct campaign_segment *seg = c->seg;
+    char runs[32], failures[32];
+    format_limit(runs, sizeof(runs), seg->max_runs);
+    format_limit(failures, sizeof(failures), seg->max_failures);
+
+    if (seg->max_runs != max_runs || seg->max_failures != max_failures) {
+        warnx("campaign %s: using its limits (runs: %s, failures: %s), "
+            "not this instance's -r and -f", path, runs, failures);
+    }
+    if (campaign_stopped(c) || LOAD(&seg->next_run_id) >= seg->max_runs) {
+        errx(1, "campaign %s: already finished (%llu runs, %llu failures); "
+            "remove it to start a new campaign", path,
+            (unsigned long long)LOAD(&seg->runs_finished),
+            (unsigned long long)LOAD(&seg->failures));
+    }
+}
+
+struct campaign *campaign_open(const char *path,
+    size_t max_runs, size_t max_failures) {
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) { err(1, "open: %s", path); }
+
+    /* Hold a lock while checking the file, so exactly one instance
+     * initializes it, and only if it was empty. Anything else must
+     * already be a campaign, or it's left untouched. */
+    lock_file(path, fd, F_WRLCK);
+    struct stat st;
+    if (-1 == fstat(fd, &st)) { err(1, "fstat: %s", path); }
+
+    const size_t size = sizeof(struct campaign_segment);
+    const bool created = st.st_size == 0;
+    if (created) {
+        if (-1 == ftruncate(fd, size)) { err(1, "ftruncate: %s", path); }
+    } else if ((size_t)st.st_size != size) {
+        errx(1, "campaign %s: not a campaign file", path);
+    }
+
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) { err(1, "mmap: %s", path); }
+    struct campaign_segment *seg = p;
+
+    if (created) {
+        seg->magic = CAMPAIGN_MAGIC;
+        seg->version = CAMPAIGN_VERSION;
+        seg->max_runs = max_runs;
+        seg->max_failures = max_failures;
+    } else if (seg->magic != CAMPAIGN_MAGIC
+        || seg->version != CAMPAIGN_VERSION) {
+        errx(1, "campaign %s: not a campaign file, or incompatible version",
+            path);
+    }
+    lock_file(path, fd, F_UNLCK);
+    if (-1 == close(fd)) { err(1, "close"); }
+
+    struct campaign *c = calloc(1, sizeof(*c));
+    if (c == NULL) { err(1, "calloc"); }
+    c->seg = seg;
+    if (!created) { check_joined(path, c, max_runs, max_failures); }
+    c->owner = getpid();
+    INCR(&seg->instances);
+    INCR(&seg->instances_active);
+    return c;
+}
+
+bool campaign_stopped(const struct campaign *c) {
+    struct campaign_segment *seg = c->seg;
+    return LOAD(&seg->stop) != 0
+        || LOAD(&seg->failures) >= seg->max_failures;
+}
+
+bool campaign_claim_run(struct campaign *c, size_t *run_id) {
+    struct campaign_segment *seg = c->seg;
+    if (campaign_stopped(c)) { return false; }
+
+    /* IDs past max_runs are burned, but that's harmless: every
+     * instance that sees one stops claiming. */
+    const uint64_t id = INCR(&seg->next_run_id);
+    if (id > seg->max_runs) { return false; }
+    *run_id = (size_t)id;
+    return true;
+}
+
+bool campaign_record_run(struct campaign *c, bool failed) {
+    struct campaign_segment *seg = c->seg;
+    INCR(&seg->runs_finished);
+    if (failed) {
+        if (INCR(&seg->failures) >= seg->max_failures) {
+            STORE(&seg->stop, 1);
+        }
+    }
+    return campaign_stopped(c);
+}
+
+void campaign_totals(const struct campaign *c,
+    struct campaign_totals *totals) {
+    struct campaign_segment *seg = c->seg;
+    const uint64_t claimed = LOAD(&seg->next_run_id);
+    totals->max_runs = seg->max_runs;
+    totals->max_failures = seg->max_failures;
+    totals->runs_claimed = claimed < seg->max_runs ? claimed : seg->max_runs;
+    totals->runs_finished = LOAD(&seg->runs_finished);
+    totals->failures = LOAD(&seg->failures);
+    totals->instances = LOAD(&seg->instances);
+    totals->instances_active = LOAD(&seg->instances_active);
+    totals->stopped = campaign_stopped(c);
+}
+
+void campaign_close(struct campaign *c) {
+    if (c == NULL) { return; }
+
+    /* Only the instance that joined may leave, and only once: a forked
+     * child exiting with our handlers still registered must not count
+     * us out. Never go below zero, either, in case of a stale file. */
+    if (getpid() == c->owner) {
+        uint64_t active = LOAD(&c->seg->instances_active);
+        while (active > 0 && !__atomic_compare_exchange_n(
+                &c->seg->instances_active, &active, active - 1, false,
+                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            continue;
+        }
+    }
+    if (-1 == munmap(c->seg, sizeof(*c->seg))) { err(1, "munmap"); }
+    free(c);
+}
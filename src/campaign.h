@@ -0,0 +1,48 @@
+#ifndef CAMPAIGN_H
+#define CAMPAIGN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A campaign is a memory-mapped file shared by several cooperating
+ * autoclave processes on the same host. It hands out globally unique
+ * run IDs and enforces max-runs / max-failures across all of them. */
+struct campaign;
+
+struct campaign_totals {
+    uint64_t max_runs;
+    uint64_t max_failures;
+    uint64_t runs_claimed;
+    uint64_t runs_finished;
+    uint64_t failures;
+    uint64_t instances;
+    uint64_t instances_active;
+    bool stopped;
+};
+
+/* Open (creating and initializing if necessary) the campaign at PATH.
+ * The first instance to initialize the segment sets its limits;
+ * later instances adopt them. An existing file that isn't a campaign
+ * is left untouched. Exits via err(3) on failure. */
+struct campaign *campaign_open(const char *path,
+    size_t max_runs, size_t max_failures);
+
+/* Claim the next run ID. Returns false once the campaign's run
+ * limit has been reached or the campaign has been stopped. */
+bool campaign_claim_run(struct campaign *c, size_t *run_id);
+
+/* Record a finished run. Returns true if the campaign should stop,
+ * because the shared failure limit has been reached. */
+bool campaign_record_run(struct campaign *c, bool failed);
+
+bool campaign_stopped(const struct campaign *c);
+
+void campaign_totals(const struct campaign *c,
+    struct campaign_totals *totals);
+
+/* Detach from the campaign. The file is left in place, so later
+ * instances continue the same campaign until it is removed. */
+void campaign_close(struct campaign *c);
+
+#endif
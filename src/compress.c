@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2015-18 Scott Vokes <vokes.s@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include <signal.h>
+#include <pthread.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "compress.h"
+
+/* Max logs waiting to be compressed. Removals can use the rest of the
+ * ring, so rotation doesn't have to wait for a full queue to drain. */
+#define MAX_PENDING_LOGS 64
+#define QUEUE_CEIL (2 * MAX_PENDING_LOGS)
+
+#define BUF_SIZE (64 * 1024)
+
+enum job_type {
+    JOB_COMPRESS,
+    JOB_UNLINK,
+};
+
+struct job {
+    enum job_type type;
+    char path[PATH_MAX];
+};
+
+struct compressor {
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool stopping;
+
+    /* Ring of queued jobs, protected by lock. */
+    size_t head;
+    size_t count;
+    size_t pending_logs;        /* JOB_COMPRESS entries in the ring */
+    struct job jobs[QUEUE_CEIL];
+
+    /* Only touched by the worker until it's joined. */
+    size_t compressed;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    size_t errors;
+
+    size_t skipped;             /* left uncompressed, queue was full */
+};
+
+/* Compress PATH to PATH.gz, via a temporary file. The worker must not
+ * exit the process on errors, since the main thread may be joining it. */
+static void compress_one(struct compressor *c, const char *path) {
+    char tmp[PATH_MAX + 8];
+    char dst[PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.gz.tmp", path);
+    snprintf(dst, sizeof(dst), "%s.gz", path);
+
+    const int in = open(path, O_RDONLY);
+    if (in == -1) {
+        /* Already rotated out, perhaps. */
+        if (errno != ENOENT) { warn("open: %s", path); c->errors++; }
+        return;
+    }
+    gzFile out = gzopen(tmp, "wb1");
+    if (out == NULL) {
+        warn("gzopen: %s", tmp);
+        c->errors++;
+        (void)close(in);
+        return;
+    }
+
+    static char buf[BUF_SIZE];
+    uint64_t total = 0;
+    bool ok = true;
+    for (;;) {
+        ssize_t rd = read(in, buf, sizeof(buf));
+        if (rd == -1) {
+            if (errno == EINTR) { continue; }
+            warn("read: %s", path);
+            ok = false;
+            break;
+        } else if (rd == 0) {
+            break;
+        }
+        if (gzwrite(out, buf, (unsigned)rd) != (int)rd) {
+            warnx("gzwrite: %s: failed", tmp);
+            ok = false;
+            break;
+        }
+        total += rd;
+    }
+    (void)close(in);
+    if (gzclose(out) != Z_OK) {
+        warnx("gzclose: %s: failed", tmp);
+        ok = false;
+    }
+
+    struct stat st;
+    if (ok && -1 == rename(tmp, dst)) {
+        warn("rename: %s", tmp);
+        ok = false;
+    }
+    if (!ok) {
+        (void)unlink(tmp);
+        c->errors++;
+        return;
+    }
+    (void)unlink(path);
+
+    c->compressed++;
+    c->bytes_in += total;
+    if (0 == stat(dst, &st)) { c->bytes_out += st.st_size; }
+}
+
+static void unlink_one(const char *path) {
+    char gz[PATH_MAX + 8];
+    snprintf(gz, sizeof(gz), "%s.gz", path);
+    if (-1 == unlink(gz) && errno != ENOENT) { warn("unlink: %s", gz); }
+    if (-1 == unlink(path) && errno != ENOENT) { warn("unlink: %s", path); }
+}
+
+static void *worker(void *arg) {
+    struct compressor *c = arg;
+    struct job job;
+
+    pthread_mutex_lock(&c->lock);
+    for (;;) {
+        while (c->count == 0 && !c->stopping) {
+            pthread_cond_wait(&c->cond, &c->lock);
+        }
+        if (c->count == 0) { break; }   /* stopping, and drained */
+
+        job = c->jobs[c->head];
+        c->head = (c->head + 1) % QUEUE_CEIL;
+        c->count--;
+        if (job.type == JOB_COMPRESS) { c->pending_logs--; }
+        pthread_mutex_unlock(&c->lock);
+
+        if (job.type == JOB_COMPRESS) {
+            compress_one(c, job.path);
+        } else {
+            unlink_one(job.path);
+        }
+        errno = 0;
+
+        pthread_mutex_lock(&c->lock);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+struct compressor *compress_start(void) {
+    struct compressor *c = calloc(1, sizeof(*c));
+    if (c == NULL) { err(1, "calloc"); }
+    if (0 != pthread_mutex_init(&c->lock, NULL)) { errx(1, "mutex_init"); }
+    if (0 != pthread_cond_init(&c->cond, NULL)) { errx(1, "cond_init"); }
+
+    /* Start the worker with all signals blocked, so SIGCHLD and SIGINT
+     * are always handled by the main thread. */
+    sigset_t all, old;
+    sigfillset(&all);
+    if (0 != pthread_sigmask(SIG_SETMASK, &all, &old)) {
+        errx(1, "pthread_sigmask");
+    }
+    if (0 != pthread_create(&c->worker, NULL, worker, c)) {
+        errx(1, "pthread_create");
+    }
+    if (0 != pthread_sigmask(SIG_SETMASK, &old, NULL)) {
+        errx(1, "pthread_sigmask");
+    }
+    return c;
+}
+
+/* Add a job, unless the ring is full. Called with the lock held. */
+static bool push(struct compressor *c, enum job_type type, const char *path) {
+    if (c->count == QUEUE_CEIL) { return false; }
+    struct job *job = &c->jobs[(c->head + c->count) % QUEUE_CEIL];
+    job->type = type;
+    snprintf(job->path, sizeof(job->path), "%s", path);
+    c->count++;
+    pthread_cond_signal(&c->cond);
+    return true;
+}
+
+bool compress_log(struct compressor *c, const char *path) {
+    bool queued = false;
+    pthread_mutex_lock(&c->lock);
+    if (c->pending_logs < MAX_PENDING_LOGS) {
+        queued = push(c, JOB_COMPRESS, path);
+        if (queued) { c->pending_logs++; }
+    }
+    if (!queued) { c->skipped++; }
+    pthread_mutex_unlock(&c->lock);
+    return queued;
+}
+
+void compress_unlink(struct compressor *c, const char *path) {
+    pthread_mutex_lock(&c->lock);
+    const bool queued = push(c, JOB_UNLINK, path);
+    pthread_mutex_unlock(&c->lock);
+
+    /* If even the space reserved for removals is full, remove it
+     * now. At worst, this races with compressing it, and leaves a
+     * stray .gz behind. */
+    if (!queued) { unlink_one(path); }
+}
+
+void compress_finish(struct compressor *c, FILE *out) {
+    pthread_mutex_lock(&c->lock);
+    c->stopping = true;
+    pthread_cond_signal(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+    if (0 != pthread_join(c->worker, NULL)) { errx(1, "pthread_join"); }
+
+    fprintf(out, "-- compressed %zu log%s, %llu -> %llu bytes",
+        c->compressed, c->compressed == 1 ? "" : "s",
+        (unsigned long long)c->bytes_in, (unsigned long long)c->bytes_out);
+    if (c->skipped > 0) {
+        fprintf(out, ", %zu left uncompressed (queue full)", c->skipped);
+    }
+    if (c->errors > 0) {
+        fprintf(out, ", %zu error%s", c->errors, c->errors == 1 ? "" : "s");
+    }
+    fprintf(out, "\n");
+
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->cond);
+    free(c);
+}
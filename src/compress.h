@@ -0,0 +1,29 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/* Background compression of finished logs (-z). A worker thread gzips
+ * each log to a temporary file, renames it into place as PATH.gz, and
+ * then removes the original, so slow disks never stall the supervisor
+ * loop. Its queue is bounded: if it fills up, logs are left as is. */
+struct compressor;
+
+/* Start the worker thread. Exits via err(3) on failure. */
+struct compressor *compress_start(void);
+
+/* Queue the log at PATH to be compressed. Returns false, leaving it
+ * uncompressed, if the queue is full. */
+bool compress_log(struct compressor *c, const char *path);
+
+/* Queue the log at PATH (or PATH.gz, once compressed) to be removed,
+ * after any compression of it that is still pending. */
+void compress_unlink(struct compressor *c, const char *path);
+
+/* Finish everything queued, stop the worker, print a summary to OUT,
+ * and free C. This takes the queue's lock, so it must not be called
+ * from a signal handler. */
+void compress_finish(struct compressor *c, FILE *out);
+
+#endif
@@ -0,0 +1,324 @@
+/*
+ * Copyright (c) 2015-18 Scott Vokes <vokes.s@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/* Lightweight hang snapshots, read from /proc (and optionally ptrace)
+ * rather than by attaching a full debugger. Linux-only; elsewhere,
+ * hang_snapshot just reports that it is unsupported. */
+
+#ifdef __linux__
+#define _GNU_SOURCE             /* __WALL, ptrace requests */
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <err.h>
+#include <errno.h>
+
+#include "hang.h"
+#include "proc.h"
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <elf.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+
+#define MAX_FRAMES 64
+#define MAX_MAPS 512
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define HAVE_UNWIND 1
+#endif
+
+struct mapping {
+    uintptr_t start;
+    uintptr_t end;
+    uintptr_t offset;
+    char name[64];
+};
+
+struct maps {
+    size_t count;
+    struct mapping m[MAX_MAPS];
+};
+
+static void chomp(char *buf) {
+    size_t len = strlen(buf);
+    while (len > 0 && buf[len - 1] == '\n') { buf[--len] = '\0'; }
+}
+
+static void read_maps(pid_t pid, struct maps *maps) {
+    maps->count = 0;
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/maps", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) { return; }
+
+    char line[512];
+    while (maps->count < MAX_MAPS && fgets(line, sizeof(line), f)) {
+        unsigned long start, end, offset;
+        char perms[8];
+        char name[256] = "";
+        int n = sscanf(line, "%lx-%lx %7s %lx %*s %*s %255s",
+            &start, &end, perms, &offset, name);
+        if (n < 4 || perms[2] != 'x') { continue; }
+        struct mapping *m = &maps->m[maps->count++];
+        m->start = start;
+        m->end = end;
+        m->offset = offset;
+        const char *base = strrchr(name, '/');
+        snprintf(m->name, sizeof(m->name), "%.63s",
+            base ? base + 1 : (name[0] ? name : "[anon]"));
+    }
+    fclose(f);
+}
+
+static void print_addr(FILE *out, size_t frame, uintptr_t addr,
+    const struct maps *maps) {
+    for (size_t i = 0; i < maps->count; i++) {
+        const struct mapping *m = &maps->m[i];
+        if (addr >= m->start && addr < m->end) {
+            fprintf(out, "      #%-2zu 0x%016llx %s+0x%llx\n", frame,
+                (unsigned long long)addr, m->name,
+                (unsigned long long)(addr - m->start + m->offset));
+            return;
+        }
+    }
+    fprintf(out, "      #%-2zu 0x%016llx ?\n", frame,
+        (unsigned long long)addr);
+}
+
+static void print_proc_file(FILE *out, const char *label,
+    const char *path, bool multiline) {
+    char buf[4096];
+    if (proc_read_file(path, buf, sizeof(buf)) == -1) {
+        fprintf(out, "    %s: (unavailable: %s)\n", label, strerror(errno));
+        errno = 0;
+        return;
+    }
+    chomp(buf);
+    if (!multiline) {
+        fprintf(out, "    %s: %s\n", label, buf[0] ? buf : "-");
+        return;
+    }
+
+    fprintf(out, "    %s:\n", label);
+    char *saveptr = NULL;
+    for (char *l = strtok_r(buf, "\n", &saveptr); l != NULL;
+         l = strtok_r(NULL, "\n", &saveptr)) {
+        fprintf(out, "      %s\n", l);
+    }
+}
+
+#ifdef HAVE_UNWIND
+static bool peek(pid_t tid, uintptr_t addr, uintptr_t *out) {
+    errno = 0;
+    long word = ptrace(PTRACE_PEEKDATA, tid, (void *)addr, NULL);
+    if (word == -1 && errno != 0) { return false; }
+    *out = (uintptr_t)word;
+    return true;
+}
+
+/* Walk the frame-pointer chain of a stopped thread. Code built
+ * without frame pointers will produce a truncated stack. */
+static void unwind(FILE *out, pid_t tid, const struct maps *maps) {
+#if defined(__x86_64__)
+    struct user_regs_struct regs;
+#elif defined(__aarch64__)
+    struct user_pt_regs regs;
+#endif
+    struct iovec iov = { .iov_base = &regs, .iov_len = sizeof(regs) };
+    if (-1 == ptrace(PTRACE_GETREGSET, tid, (void *)NT_PRSTATUS, &iov)) {
+        fprintf(out, "      (registers unavailable: %s)\n",
+            strerror(errno));
+        errno = 0;
+        return;
+    }
+
+#if defined(__x86_64__)
+    uintptr_t pc = regs.rip;
+    uintptr_t fp = regs.rbp;
+#elif defined(__aarch64__)
+    uintptr_t pc = regs.pc;
+    uintptr_t fp = regs.regs[29];
+#endif
+
+    size_t frame = 0;
+    print_addr(out, frame++, pc, maps);
+    while (frame < MAX_FRAMES && fp != 0
+        && fp % sizeof(uintptr_t) == 0) {
+        uintptr_t next_fp, ret;
+        if (!peek(tid, fp, &next_fp)) { break; }
+        if (!peek(tid, fp + sizeof(uintptr_t), &ret)) { break; }
+        if (ret == 0) { break; }
+        print_addr(out, frame++, ret, maps);
+        /* The stack grows down, so callers' frames must be above. */
+        if (next_fp <= fp) { break; }
+        fp = next_fp;
+    }
+}
+#endif
+
+/* Stop a thread with PTRACE_SEIZE + PTRACE_INTERRUPT, which (unlike
+ * PTRACE_ATTACH) doesn't send it a SIGSTOP that could be observed. */
+static bool seize(pid_t tid) {
+    if (-1 == ptrace(PTRACE_SEIZE, tid, NULL, NULL)) { return false; }
+    if (-1 == ptrace(PTRACE_INTERRUPT, tid, NULL, NULL)) {
+        (void)ptrace(PTRACE_DETACH, tid, NULL, NULL);
+        return false;
+    }
+    for (;;) {
+        int status = 0;
+        pid_t res = waitpid(tid, &status, __WALL);
+        if (res == -1 && errno == EINTR) { continue; }
+        if (res == tid && WIFSTOPPED(status)) { return true; }
+        return false;           /* exited, or already reaped */
+    }
+}
+
+static void snapshot_threads(FILE *out, pid_t pid,
+    enum hang_detail detail) {
+    char path[128];
+    snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+    DIR *d = opendir(path);
+    if (d == NULL) {
+        fprintf(out, "  (threads unavailable: %s)\n", strerror(errno));
+        errno = 0;
+        return;
+    }
+
+    struct maps *maps = NULL;
+    if (detail >= HANG_USER_STACKS) {
+        maps = malloc(sizeof(*maps));
+        if (maps != NULL) { read_maps(pid, maps); }
+    }
+
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (!proc_is_numeric(de->d_name)) { continue; }
+        const pid_t tid = (pid_t)strtol(de->d_name, NULL, 10);
+        char comm[64] = "?";
+        char state = '?';
+        snprintf(path, sizeof(path), "/proc/%d/task/%d/stat",
+            (int)pid, (int)tid);
+        (void)proc_parse_stat(path, comm, sizeof(comm), &state, NULL);
+        fprintf(out, "  thread %d (%s) state %c\n", (int)tid, comm, state);
+
+        snprintf(path, sizeof(path), "/proc/%d/task/%d/wchan",
+            (int)pid, (int)tid);
+        print_proc_file(out, "wchan", path, false);
+        snprintf(path, sizeof(path), "/proc/%d/task/%d/syscall",
+            (int)pid, (int)tid);
+        print_proc_file(out, "syscall", path, false);
+        snprintf(path, sizeof(path), "/proc/%d/task/%d/stack",
+            (int)pid, (int)tid);
+        print_proc_file(out, "kernel stack", path, true);
+
+        if (maps != NULL) {
+            fprintf(out, "    user stack:\n");
+#ifdef HAVE_UNWIND
+            if (seize(tid)) {
+                unwind(out, tid, maps);
+                (void)ptrace(PTRACE_DETACH, tid, NULL, NULL);
+            } else {
+                fprintf(out, "      (ptrace unavailable: %s)\n",
+                    strerror(errno));
+            }
+            errno = 0;
+#else
+            (void)seize;
+            fprintf(out, "      (unsupported on this architecture)\n");
+#endif
+        }
+    }
+    closedir(d);
+    free(maps);
+}
+
+static void snapshot_process(FILE *out, pid_t pid, pid_t ppid,
+    enum hang_detail detail) {
+    char path[64];
+    char comm[64] = "?";
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    (void)proc_parse_stat(path, comm, sizeof(comm), NULL, NULL);
+    fprintf(out, "process %d (%s) ppid %d\n", (int)pid, comm, (int)ppid);
+
+    /* cmdline is NUL-separated */
+    char cmdline[1024];
+    snprintf(path, sizeof(path), "/proc/%d/cmdline", (int)pid);
+    ssize_t len = proc_read_file(path, cmdline, sizeof(cmdline));
+    if (len > 0) {
+        for (ssize_t i = 0; i < len - 1; i++) {
+            if (cmdline[i] == '\0') { cmdline[i] = ' '; }
+        }
+        fprintf(out, "  cmdline: %s\n", cmdline);
+    }
+    errno = 0;
+
+    snapshot_threads(out, pid, detail);
+}
+
+bool hang_snapshot(pid_t pid, const char *path, enum hang_detail detail) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        warn("fopen: %s", path);
+        return false;
+    }
+
+    fprintf(out, "autoclave hang snapshot of pid %d\n\n", (int)pid);
+
+    /* The hung process comes first, then its descendants. */
+    struct proc_table all = { 0 };
+    struct proc_table tree = { 0 };
+    proc_scan(&all);
+    proc_tree(&all, pid, getpid(), &tree);
+    for (size_t i = 0; i < tree.count; i++) {
+        snapshot_process(out, tree.entries[i].pid, tree.entries[i].ppid,
+            detail);
+        fprintf(out, "\n");
+    }
+    proc_table_free(&all);
+    proc_table_free(&tree);
+
+    if (0 != fclose(out)) {
+        warn("fclose: %s", path);
+        return false;
+    }
+    errno = 0;
+    return true;
+}
+
+#else
+
+bool hang_snapshot(pid_t pid, const char *path, enum hang_detail detail) {
+    (void)pid;
+    (void)path;
+    (void)detail;
+    static bool warned = false;
+    if (!warned) {
+        warnx("hang snapshots (-H) are only supported on Linux");
+        warned = true;
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef HANG_H
+#define HANG_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* Levels for -H: repeating the flag adds more (and slower) detail. */
+enum hang_detail {
+    HANG_NONE,
+    HANG_PROC,                  /* thread state, wchan, syscall, kstack */
+    HANG_USER_STACKS,           /* ... plus ptrace frame-pointer unwind */
+};
+
+/* Write a snapshot of the process tree rooted at PID to the file PATH,
+ * without stopping it for longer than it takes to read the registers.
+ * Returns false (after printing a warning) if no snapshot could be
+ * taken, e.g. on platforms without /proc. */
+bool hang_snapshot(pid_t pid, const char *path, enum hang_detail detail);
+
+#endif
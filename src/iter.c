@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2015-18 Scott Vokes <vokes.s@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <err.h>
+#include <errno.h>
+
+#include "iter.h"
+
+bool iter_send(int fd, size_t run_id) {
+    char buf[32];
+    const int len = snprintf(buf, sizeof(buf), "R %zu\n", run_id);
+
+    bool ok = true;
+    for (int used = 0; used < len; ) {
+        ssize_t wr = write(fd, &buf[used], len - used);
+        if (wr == -1) {
+            if (errno == EINTR) { continue; }
+            if (errno != EPIPE) { err(1, "write"); }
+            ok = false;
+            break;
+        }
+        used += wr;
+    }
+    errno = 0;
+    return ok;
+}
+
+bool iter_fill(struct iter_batch *b) {
+    for (;;) {
+        const size_t avail = sizeof(b->report_buf) - b->report_len;
+        if (avail == 0) { return true; }   /* pop some reports first */
+        ssize_t rd = read(b->report_fd, &b->report_buf[b->report_len], avail);
+        if (rd > 0) {
+            b->report_len += rd;
+        } else if (rd == 0) {
+            return false;
+        } else if (errno == EINTR) {
+            errno = 0;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            errno = 0;
+            return true;
+        } else {
+            err(1, "read");
+        }
+    }
+}
+
+enum iter_report iter_next_report(struct iter_batch *b, size_t *run_id) {
+    for (;;) {
+        char *nl = memchr(b->report_buf, '\n', b->report_len);
+        if (nl == NULL) {
+            if (b->report_len == sizeof(b->report_buf)) {
+                warnx("iteration report too long, discarding");
+                b->report_len = 0;
+            }
+            return ITER_NONE;
+        }
+        *nl = '\0';
+        char type = '\0';
+        size_t id = 0;
+        const int fields = sscanf(b->report_buf, "%c %zu", &type, &id);
+
+        const size_t line_len = nl - b->report_buf + 1;
+        char line[sizeof(b->report_buf)];
+        memcpy(line, b->report_buf, line_len);
+        memmove(b->report_buf, &b->report_buf[line_len],
+            b->report_len - line_len);
+        b->report_len -= line_len;
+
+        if (fields == 2
+            && (type == ITER_START || type == ITER_PASS || type == ITER_FAIL)) {
+            *run_id = id;
+            return (enum iter_report)type;
+        }
+        warnx("malformed iteration report: %s", line);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef ITER_H
+#define ITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/* The iteration protocol (-N), which lets one exec of a target serve
+ * several runs. autoclave writes "R <run_id>\n" to the target's control
+ * fd to start each iteration, and closes it when there are no more. The
+ * target writes "S <run_id>\n" to its report fd when the iteration
+ * starts, then "P <run_id>\n" if it passed or "F <run_id>\n" if it
+ * failed. See autoclave_iter.h for the target's side. */
+
+enum iter_report {
+    ITER_NONE = 0,
+    ITER_START = 'S',
+    ITER_PASS = 'P',
+    ITER_FAIL = 'F',
+};
+
+/* A running target serving iterations. */
+struct iter_batch {
+    pid_t pid;                  /* 0 when none is running */
+    size_t target;              /* index of the target it runs */
+    size_t first_id;            /* run ID its logs are named after */
+    size_t remaining;           /* iterations not handed out yet */
+    int control_fd;             /* -1 once closed */
+    int report_fd;              /* -1 once closed */
+    int outlog;
+    int errlog;
+    bool failed;                /* whether any of its iterations failed */
+    bool reported;              /* it has sent any report at all */
+    bool started;               /* current iteration reported its start */
+    struct timeval start;       /* when it did */
+    struct rusage pre_usage;    /* since the current iteration... */
+    double cpu_base;            /* ...and the CPU msec it had used by then */
+    size_t report_len;
+    char report_buf[64];
+};
+
+/* Send the run ID for the next iteration. Returns false if the target
+ * has already closed its end. SIGPIPE must not have its default action,
+ * so that shows up as EPIPE rather than killing autoclave. */
+bool iter_send(int fd, size_t run_id);
+
+/* Read whatever reports are available from the (non-blocking) report
+ * fd into B's buffer. Returns false once the target closes it. */
+bool iter_fill(struct iter_batch *b);
+
+/* Pop the next complete report from B's buffer, if any. Malformed
+ * lines are skipped, with a warning. */
+enum iter_report iter_next_report(struct iter_batch *b, size_t *run_id);
+
+#endif
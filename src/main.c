@@ -27,6 +27,7 @@
 #include <poll.h>
 #include <time.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <libgen.h>
 #include <ctype.h>
@@ -38,17 +39,30 @@
 #define AUTOCLAVE_AUTHOR "Scott Vokes <vokes.s@gmail.com>"
 
 #include "types.h"
+#include "campaign.h"
+#include "hang.h"
+#include "regress.h"
+#include "sched.h"
+#include "trace.h"
+#include "sample.h"
+#include "perf.h"
+#include "iter.h"
+#include "proc.h"
+#include "compress.h"
 
 static const char REASON_UNDEF[] = "undef";
 static const char REASON_TIMEOUT[] = "timeout";
 static const char REASON_EXIT[] = "exit";
 static const char REASON_TERM[] = "term";
 static const char REASON_STOP[] = "stop";
-
-static char output_prefix_buf[PATH_MAX];
+static const char REASON_ITERATION[] = "iteration";
+static const char REASON_NO_RESULT[] = "no_result";
 
 static const struct config * cfg;
 
+/* The target for the current run. */
+static const struct target *target;
+
 static struct state state;
 
 /* There apparently isn't a POSIX-standard portable way to
@@ -69,27 +83,46 @@ static void usage(const char *msg) {
         AUTOCLAVE_VERSION_MAJOR, AUTOCLAVE_VERSION_MINOR,
         AUTOCLAVE_VERSION_PATCH, AUTOCLAVE_AUTHOR);
     fprintf(stderr,
-        "Usage: autoclave [-h] [-c <count>] [-l] [-e] [-f <max_failures>]\n"
-        "                 [-i <id_str>] [-I <exits>] [-k <signal>]\n"
-        "                 [-m <min_duration_msec>] [-o <output_prefix>]\n"
-        "                 [-r <max_runs>] [-s] [-t <timeout_sec>] [-v]\n"
-        "                 [-x <cmd>] <command line>\n"
+        "Usage: autoclave [-h] [-b <baseline>] [-B <baseline>] [-C]\n"
+        "                 [-c <count>] [-E] [-l] [-e] [-f <max_failures>] [-H]\n"
+        "                 [-i <id_str>] [-I <exits>] [-j <job_file>]\n"
+        "                 [-k <signal>]\n"
+        "                 [-m <min_duration_msec>] [-N <iterations>]\n"
+        "                 [-o <output_prefix>]\n"
+        "                 [-p <threshold_pct>] [-P <sample_msec>] [-D] [-G]\n"
+        "                 [-r <max_runs>] [-s] [-S <campaign>]\n"
+        "                 [-t <timeout_sec>] [-T <trace>] [-v] [-x <cmd>] [-z]\n"
+        "                 [<command line>]\n"
         "\n"
         "    -h:         print this help\n"
+        "    -b PATH:    save run durations as a performance baseline\n"
+        "    -B PATH:    compare run durations against a saved baseline\n"
+        "    -C:         compare CPU time rather than wall-clock time\n"
+        "    -D:         include descendants when sampling (-P)\n"
         "    -c COUNT:   rotate log files by count\n"
+        "    -E:         record perf_event counters for each run\n"
         "    -f COUNT:   max failures (def. 1)\n"
+        "    -G:         flag runs whose RSS or open fds keep growing\n"
+        "    -H:         save a hang snapshot on timeout (-HH: + user stacks)\n"
         "    -i STR:     replace STR in args with run_id\n"
         "    -I INTS:    non-zero exit values to ignore (comma-separated list)\n"
+        "    -j PATH:    run the commands listed in a job file, sharing -r\n"
         "    -k SIGNAL:  signal to send process on timeout (int or name)\n"
         "    -l:         log stdout\n"
         "    -e:         log stderr\n"
+        "    -N COUNT:   run up to COUNT iterations per exec (see autoclave_iter.h)\n"
         "    -m MSEC:    min duration per run, will delay to pad (def. 50 msec)\n"
         "    -o PATH:    log output prefix (default: program's $0)\n"
+        "    -p PCT:     slowdown considered a regression (def. 5%%)\n"
+        "    -P MSEC:    sample the child's resource usage every MSEC\n"
         "    -r COUNT:   max runs (def. no limit)\n"
         "    -t SEC:     timeout for watched program (in seconds)\n"
+        "    -T PATH:    write a Chrome/Perfetto trace of the campaign\n"
         "    -s:         supervise (abbreviation for `-l -e -v`)\n"
+        "    -S PATH:    share run IDs and -r/-f limits via campaign file\n"
         "    -v:         increase verbosity\n"
         "    -x CMD:     execute command on error/timeout\n"
+        "    -z:         gzip finished logs in the background\n"
         );
     
     exit(1);
@@ -123,11 +156,11 @@ static int signal_id_from_str(const char *name) {
     return -1;
 }
 
-static bool set_ignored_exits(struct config *cfg, char *arg) {
+static bool set_ignored_exits(uint64_t *ignored_exits, const char *arg) {
     const size_t cp_len = strlen(arg);
     char arg_cp[cp_len + 1];
     memset(arg_cp, 0x00, cp_len + 1);
-    strncpy(arg_cp, arg, cp_len);
+    memcpy(arg_cp, arg, cp_len);
 
     char *list = arg_cp;
     for (;;) {
@@ -142,7 +175,7 @@ static bool set_ignored_exits(struct config *cfg, char *arg) {
         if (errno == ERANGE || num > 0377) { return false; }
 
         // Set flag bit for ignored exit.
-        cfg->ignored_exits[num / 64] |= (1LLU << (num % 64));
+        ignored_exits[num / 64] |= (1LLU << (num % 64));
     }
 
     return true;
@@ -150,30 +183,54 @@ static bool set_ignored_exits(struct config *cfg, char *arg) {
 
 static void handle_args(struct config *cfg, int argc, char **argv) {
     int fl = 0;
-    while ((fl = getopt(argc, argv, "hc:ef:I:i:k:lm:o:r:st:vx:")) != -1) {
+    while ((fl = getopt(argc, argv, "hb:B:Cc:DEeGf:HI:i:j:k:lm:N:o:p:P:r:sS:t:T:vx:z")) != -1) {
         switch (fl) {
         case 'h':               /* help */
             usage(NULL);
             break;
+        case 'b':               /* save baseline */
+            cfg->baseline_save_path = optarg;
+            break;
+        case 'B':               /* compare against baseline */
+            cfg->baseline_path = optarg;
+            break;
+        case 'C':               /* compare CPU time */
+            cfg->regress_metric = REGRESS_CPU;
+            break;
         case 'c':               /* rotation count */
             cfg->rot.type = ROT_COUNT;
             cfg->rot.u.count.count = (size_t)strtoll(optarg, NULL, 10);
             break;
+        case 'D':               /* sample descendants */
+            cfg->sample_descendants = true;
+            break;
+        case 'E':               /* perf counters */
+            cfg->perf_counters = true;
+            break;
         case 'e':               /* log stderr */
             cfg->log_stderr = true;
             break;
         case 'f':               /* max failures */
             cfg->max_failures = (size_t)strtoll(optarg, NULL, 10);
             break;
+        case 'G':               /* flag resource growth */
+            cfg->flag_growth = true;
+            break;
+        case 'H':               /* hang snapshot detail */
+            if (cfg->hang_detail < HANG_USER_STACKS) { cfg->hang_detail++; }
+            break;
         case 'i':               /* run_id string */
             cfg->run_id_str = optarg;
             break;
         case 'I':               /* ignored exits */
-            if (!set_ignored_exits(cfg, optarg)) {
+            if (!set_ignored_exits(cfg->ignored_exits, optarg)) {
                 fprintf(stderr, "Invalid exits: %s\n", optarg);
                 usage(NULL);
             }
             break;
+        case 'j':               /* job file */
+            cfg->job_path = optarg;
+            break;
         case 'k':               /* timeout kill signal */
             cfg->timeout_kill_signal = signal_id_from_str(optarg);
             if (cfg->timeout_kill_signal == -1) {
@@ -190,6 +247,27 @@ static void handle_args(struct config *cfg, int argc, char **argv) {
         case 'o':               /* output prefix */
             cfg->output_prefix = optarg;
             break;
+        case 'p':               /* regression threshold (percent) */
+            cfg->regress_threshold_pct = strtod(optarg, NULL);
+            if (cfg->regress_threshold_pct < 0) {
+                fprintf(stderr, "Invalid threshold: %s\n", optarg);
+                usage(NULL);
+            }
+            break;
+        case 'N':               /* iterations per exec */
+            cfg->iterations = (size_t)strtoll(optarg, NULL, 10);
+            if (cfg->iterations == 0) {
+                fprintf(stderr, "Invalid iteration count: %s\n", optarg);
+                usage(NULL);
+            }
+            break;
+        case 'P':               /* sampling interval (in msec) */
+            cfg->sample_msec = (size_t)strtoll(optarg, NULL, 10);
+            if (cfg->sample_msec == 0) {
+                fprintf(stderr, "Invalid sampling interval: %s\n", optarg);
+                usage(NULL);
+            }
+            break;
         case 'r':               /* max runs */
             cfg->max_runs = (size_t)strtoll(optarg, NULL, 10);
             break;
@@ -198,62 +276,242 @@ static void handle_args(struct config *cfg, int argc, char **argv) {
             cfg->log_stderr = true;
             cfg->verbosity++;
             break;
+        case 'S':               /* shared campaign file */
+            cfg->campaign_path = optarg;
+            break;
         case 't':               /* timeout (in sec) */
             cfg->timeout_sec = (size_t)strtoll(optarg, NULL, 10);
             break;
+        case 'T':               /* trace output */
+            cfg->trace_path = optarg;
+            break;
         case 'v':               /* verbosity */
             cfg->verbosity++;
             break;
         case 'x':               /* execute error handler */
             cfg->error_handler = optarg;
             break;
+        case 'z':               /* compress logs */
+            cfg->compress_logs = true;
+            break;
         case '?':
         default:
             usage(NULL);
         }
     }
 
+    if ((cfg->sample_descendants || cfg->flag_growth)
+        && cfg->sample_msec == 0) {
+        cfg->sample_msec = DEF_SAMPLE_MSEC;
+    }
+
     argc -= (optind - 1);
     argv += (optind - 1);
     cfg->argc = argc - 1;
     cfg->argv = argv + 1;
 
-    if (cfg->argc < 1) { usage(NULL); }
+    if (cfg->job_path != NULL) {
+        if (cfg->argc > 0) {
+            usage("Use either a job file (-j) or a command line, not both.");
+        }
+        if (cfg->baseline_path != NULL || cfg->baseline_save_path != NULL) {
+            usage("Baselines (-b, -B) can't be used with a job file (-j).");
+        }
+        read_job_file(cfg, cfg->job_path);
+    } else {
+        if (cfg->argc < 1) { usage(NULL); }
+        struct target t = {
+            .argc = cfg->argc,
+            .argv = cfg->argv,
+            .timeout_sec = cfg->timeout_sec,
+        };
+        memcpy(t.ignored_exits, cfg->ignored_exits, sizeof(t.ignored_exits));
+        add_target(cfg, &t);
+    }
+
+    for (size_t i = 0; i < cfg->target_count; i++) {
+        init_output_prefix(cfg, &cfg->targets[i]);
+    }
+}    
+
+static char *basename_copy(const char *path) {
+    const size_t cp_len = strlen(path);
+    char path_cp[cp_len + 1];
+    memset(path_cp, 0x00, cp_len + 1);
+    strncpy(path_cp, path, cp_len);
+    return copy_str(basename(path_cp));
+}
+
+/* strdup(3) isn't in POSIX.1-2001 without XSI, so roll our own. */
+static char *copy_str(const char *str) {
+    const size_t len = strlen(str);
+    char *res = malloc(len + 1);
+    if (res == NULL) { err(1, "malloc"); }
+    memcpy(res, str, len + 1);
+    return res;
+}
+
+static void add_target(struct config *cfg, const struct target *t) {
+    struct target *nts = realloc(cfg->targets,
+        (cfg->target_count + 1) * sizeof(*nts));
+    if (nts == NULL) { err(1, "realloc"); }
+    cfg->targets = nts;
+    struct target *nt = &cfg->targets[cfg->target_count++];
+    *nt = *t;
+    if (nt->name == NULL) { nt->name = basename_copy(nt->argv[0]); }
+}
+
+/* Split a job file line into whitespace-separated words, in place.
+ * Words can be quoted with '...' or "..." (without escapes), and a
+ * word starting with '#' comments out the rest of the line. */
+static int split_job_line(char *line, char **words, int max_words) {
+    int count = 0;
+    char *p = line;
+    for (;;) {
+        while (isspace((unsigned char)*p)) { p++; }
+        if (*p == '\0' || *p == '#') { break; }
+        if (count == max_words) { return -1; }
+
+        char *out = p;
+        words[count++] = out;
+        while (*p != '\0' && !isspace((unsigned char)*p)) {
+            if (*p == '\'' || *p == '"') {
+                const char quote = *p++;
+                while (*p != '\0' && *p != quote) { *out++ = *p++; }
+                if (*p == '\0') { return -1; }
+                p++;
+            } else {
+                *out++ = *p++;
+            }
+        }
+        if (*p != '\0') { p++; }
+        *out = '\0';
+    }
+    return count;
+}
+
+#define MAX_JOB_WORDS 256
+
+/* Read targets from a job file. Each non-blank line is a command line,
+ * optionally preceded by per-target options:
+ *     [-n NAME] [-t SEC] [-I INTS] [-o PREFIX] [--] command args...
+ * -t and -o override the global settings, -I adds to them. */
+static void read_job_file(struct config *cfg, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) { err(1, "fopen: %s", path); }
+
+    char line[4096];
+    size_t line_no = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        if (strchr(line, '\n') == NULL && !feof(f)) {
+            errx(1, "%s:%zu: line too long", path, line_no);
+        }
+        char *words[MAX_JOB_WORDS];
+        const int count = split_job_line(line, words, MAX_JOB_WORDS);
+        if (count == -1) {
+            errx(1, "%s:%zu: unterminated quote or too many words",
+                path, line_no);
+        } else if (count == 0) {
+            continue;
+        }
 
-    if (cfg->log_stdout || cfg->log_stderr) {
+        struct target t = { .timeout_sec = cfg->timeout_sec };
+        memcpy(t.ignored_exits, cfg->ignored_exits, sizeof(t.ignored_exits));
+
+        int i = 0;
+        for (; i < count && words[i][0] == '-'; i += 2) {
+            if (0 == strcmp(words[i], "--")) { i++; break; }
+            if (words[i][1] == '\0' || words[i][2] != '\0') {
+                errx(1, "%s:%zu: unknown option: %s", path, line_no, words[i]);
+            }
+            if (i + 1 >= count) {
+                errx(1, "%s:%zu: missing argument for %s",
+                    path, line_no, words[i]);
+            }
+            char *arg = copy_str(words[i + 1]);
+
+            switch (words[i][1]) {
+            case 'n':
+                t.name = arg;
+                break;
+            case 't':
+                t.timeout_sec = (int)strtol(arg, NULL, 10);
+                break;
+            case 'I':
+                if (!set_ignored_exits(t.ignored_exits, arg)) {
+                    errx(1, "%s:%zu: invalid exits: %s", path, line_no, arg);
+                }
+                break;
+            case 'o':
+                t.output_prefix = arg;
+                break;
+            default:
+                errx(1, "%s:%zu: unknown option: %s", path, line_no, words[i]);
+            }
+        }
+        if (i >= count) { errx(1, "%s:%zu: no command", path, line_no); }
+
+        t.argc = count - i;
+        t.argv = calloc(t.argc + 1, sizeof(char *));
+        if (t.argv == NULL) { err(1, "calloc"); }
+        for (int a = 0; a < t.argc; a++) {
+            t.argv[a] = copy_str(words[i + a]);
+        }
+        add_target(cfg, &t);
+    }
+    if (ferror(f)) { err(1, "fgets: %s", path); }
+    fclose(f);
+
+    if (cfg->target_count == 0) { errx(1, "%s: no jobs", path); }
+}
+
+/* Set the target's output prefix, if it wasn't given. In a job file,
+ * targets share the global -o prefix, followed by their name. */
+static void init_output_prefix(const struct config *cfg, struct target *t) {
+    const bool explicit = t->output_prefix != NULL
+        || cfg->output_prefix != NULL;
+
+    if (t->output_prefix == NULL) {
+        char buf[PATH_MAX];
         if (cfg->output_prefix == NULL) {
-            /* Construct a default prefix for the logs. */
-            const size_t cp_len = strlen(cfg->argv[0]);
-            char argv_cp[cp_len + 1];
-            memset(argv_cp, 0x00, cp_len + 1);
-            strncpy(argv_cp, cfg->argv[0], cp_len);
-
-            (void)snprintf(output_prefix_buf, sizeof(output_prefix_buf),
-                "autoclave.%s", basename(argv_cp));
-            cfg->output_prefix = output_prefix_buf;
+            (void)snprintf(buf, sizeof(buf), "autoclave.%s", t->name);
+        } else if (cfg->job_path != NULL) {
+            (void)snprintf(buf, sizeof(buf), "%s.%s",
+                cfg->output_prefix, t->name);
         } else {
-            /* If output prefix contain any sub-directories, then
-             * attempt to create it, if not already present. */
-            const size_t cp_len = strlen(cfg->output_prefix);
-            char prefix_cp[cp_len + 1];
-            memset(prefix_cp, 0x00, cp_len + 1);
-            strncpy(prefix_cp, cfg->output_prefix, cp_len);
-            char *dir = dirname(prefix_cp);
-            if (-1 == mkdir(dir, 0700)) {
-                if (errno == EEXIST) {
-                    errno = 0;      /* already exists, ignore */
-                } else {
-                    err(1, "mkdir: %s", dir);
-                }
+            (void)snprintf(buf, sizeof(buf), "%s", cfg->output_prefix);
+        }
+        t->output_prefix = copy_str(buf);
+    }
+
+    if (explicit && (cfg->log_stdout || cfg->log_stderr
+            || cfg->hang_detail != HANG_NONE || cfg->sample_msec > 0)) {
+        /* If output prefix contain any sub-directories, then
+         * attempt to create it, if not already present. */
+        const size_t cp_len = strlen(t->output_prefix);
+        char prefix_cp[cp_len + 1];
+        memset(prefix_cp, 0x00, cp_len + 1);
+        strncpy(prefix_cp, t->output_prefix, cp_len);
+        char *dir = dirname(prefix_cp);
+        if (-1 == mkdir(dir, 0700)) {
+            if (errno == EEXIST) {
+                errno = 0;      /* already exists, ignore */
+            } else {
+                err(1, "mkdir: %s", dir);
             }
         }
     }
-}    
+}
 
 /* Pipes used for handling SIGCHLD notifications. */
 static int alert_wr_pipe;
 static int alert_rd_pipe;
 
+/* Set on SIGINT. The run in progress is abandoned, and mainloop
+ * stops and finishes up as if it had run out of runs. */
+static volatile sig_atomic_t interrupted;
+
 /* Send a notification when the child process terminates.
  * The content of the write isn't actually important,
  * it's just used to interrupt the poll and wake the
@@ -277,15 +535,29 @@ static void sigchild_handler(int sig) {
     assert(false);
 }
 
+/* Catch, rather than ignore, SIGPIPE: a handled signal is reset to
+ * its default action by exec, so targets and the failure handler
+ * don't inherit it being ignored. */
+static void sigpipe_handler(int sig) {
+    assert(sig == SIGPIPE);
+}
+
 static void sigint_handler(int sig) {
     assert(sig == SIGINT);
-    print_stats();
-    exit(state.failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+    interrupted = 1;
+    /* A second SIGINT exits immediately. */
+    (void)signal(SIGINT, SIG_DFL);
 }
 
 static int log_path(char *buf, size_t buf_size,
     size_t id, const char *fdname,
     enum log_status status) {
+    return output_path(buf, buf_size, id, fdname, ".log", status);
+}
+
+static int output_path(char *buf, size_t buf_size,
+    size_t id, const char *name, const char *ext,
+    enum log_status status) {
 
     char *status_suffix;
     switch (status) {
@@ -303,8 +575,8 @@ static int log_path(char *buf, size_t buf_size,
         assert(false);
     }
 
-    int res = snprintf(buf, buf_size, "%s%s.%zd.%s.log",
-        cfg->output_prefix, status_suffix, id, fdname);
+    int res = snprintf(buf, buf_size, "%s%s.%zd.%s%s",
+        target->output_prefix, status_suffix, id, name, ext);
 
     if ((int)buf_size < res) {
         fprintf(stderr, "snprintf: path too long\n");
@@ -313,123 +585,436 @@ static int log_path(char *buf, size_t buf_size,
     return res;
 }
 
-static bool try_exec(size_t id, struct child_status *status) {
-    memset(status, 0, sizeof(*status));
-    char outlogbuf[PATH_MAX];
-    int outlog = -1;
+static const char TAG_STDOUT[] = "stdout";
+static const char TAG_STDERR[] = "stderr";
 
-    const char *tag_stdout = "stdout";
-    const char *tag_stderr = "stderr";
+static int open_log(char *buf, size_t id, const char *tag) {
+    log_path(buf, PATH_MAX, id, tag, LOG_RUNNING);
+    int fd = open(buf, O_WRONLY | O_TRUNC | O_CREAT, 0644);
+    if (fd == -1) { err(1, "open"); }
+    return fd;
+}
 
-    if (cfg->log_stdout) {
-        log_path(outlogbuf, PATH_MAX, id, tag_stdout, LOG_RUNNING);
-        outlog = open(outlogbuf, O_WRONLY | O_TRUNC | O_CREAT, 0644);
-        if (outlog == -1) { err(1, "open"); }
-    }
+static bool try_exec(struct target_state *ts, size_t id,
+    struct child_status *status) {
+    memset(status, 0, sizeof(*status));
+    if (state.batch != NULL) { return try_iteration(ts, id, status); }
 
+    char outlogbuf[PATH_MAX];
+    const int outlog = cfg->log_stdout
+      ? open_log(outlogbuf, id, TAG_STDOUT) : -1;
     char errlogbuf[PATH_MAX];
-    int errlog = -1;
-    if (cfg->log_stderr) {
-        log_path(errlogbuf, PATH_MAX, id, tag_stderr, LOG_RUNNING);
-        errlog = open(errlogbuf, O_WRONLY | O_TRUNC | O_CREAT, 0644);
-        if (errlog == -1) { err(1, "open"); }
+    const int errlog = cfg->log_stderr
+      ? open_log(errlogbuf, id, TAG_STDERR) : -1;
+
+    const uint64_t spawn_start = trace_now();
+    if (state.samples != NULL) { sample_reset(state.samples); }
+    struct rusage pre_usage;
+    if (-1 == getrusage(RUSAGE_CHILDREN, &pre_usage)) { err(1, "getrusage"); }
+    if (state.perf != NULL) { perf_begin(state.perf); }
+
+    status->pid = spawn_child(outlog, errlog, -1, -1);
+    status->run_id = id;
+    trace_phase("spawn", spawn_start);
+    bool timed_out = false;
+    bool exited = false;
+    const uint64_t supervise_start = trace_now();
+    int stat_loc = supervise_process(status, &timed_out, &exited);
+    trace_phase("supervise", supervise_start);
+    status->cpu_msec = child_cpu_msec(&pre_usage);
+    if (state.perf != NULL) { perf_end(state.perf); }
+
+    if (interrupted) {
+        abandon_run(status->pid, exited);
+        if (outlog != -1) { close_log(outlog); }
+        if (errlog != -1) { close_log(errlog); }
+        return false;
     }
 
-    bool failed = false;
-    int kid = fork();
+    const bool failed = check_status(status, stat_loc, timed_out);
+    struct run_paths paths = {
+        .stdout_log = outlog != -1 ? outlogbuf : NULL,
+        .stderr_log = errlog != -1 ? errlogbuf : NULL,
+    };
+    handle_failure(status, failed, timed_out, &paths);
+
+    finish_logs(ts, id, outlog, errlog, failed);
+    return failed;
+}
+
+/* Fork and exec the target, with its stdout and stderr redirected to
+ * the logs, if any. With -N, it also gets the iteration protocol's
+ * control and report fds. */
+static pid_t spawn_child(int outlog, int errlog,
+    int control_fd, int report_fd) {
+    const pid_t kid = fork();
     if (kid == -1) {
         err(1, "fork");
-    } else if (kid == 0) {      /* child */
-        if (outlog != -1) {
-            if (-1 == dup2(outlog, STDOUT_FILENO)) { err(1, "dup2"); }
-        }
-        if (errlog != -1) {
-            if (-1 == dup2(errlog, STDERR_FILENO)) { err(1, "dup2"); }
-        }
-        
-        /* If run_id_str is used (e.g. `-i %`) then replace every
-         * argument matching its string with the run_id */
-        char run_id_buf[16];
-        if (cfg->run_id_str != NULL) {
-            (void)snprintf(run_id_buf, sizeof(run_id_buf),
-                "%zu", state.run_id);
-            for (int i = 1; i < cfg->argc; i++) {
-                if (0 == strcmp(cfg->argv[i], cfg->run_id_str)) {
-                    cfg->argv[i] = run_id_buf;
-                }
+    } else if (kid > 0) {       /* parent */
+        return kid;
+    }
+
+    /* child: this must leave via _exit, never exit, so the parent's
+     * atexit handlers (campaign, trace, compression) don't run here. */
+    if (outlog != -1 && -1 == dup2(outlog, STDOUT_FILENO)) {
+        warn("dup2");
+        _exit(1);
+    }
+    if (errlog != -1 && -1 == dup2(errlog, STDERR_FILENO)) {
+        warn("dup2");
+        _exit(1);
+    }
+
+    if (control_fd != -1) {
+        char buf[32];
+        (void)snprintf(buf, sizeof(buf), "%zu", cfg->iterations);
+        setenv("AUTOCLAVE_ITERATIONS", buf, 1);
+        (void)snprintf(buf, sizeof(buf), "%d", control_fd);
+        setenv("AUTOCLAVE_CONTROL_FD", buf, 1);
+        (void)snprintf(buf, sizeof(buf), "%d", report_fd);
+        setenv("AUTOCLAVE_REPORT_FD", buf, 1);
+    }
+
+    /* If run_id_str is used (e.g. `-i %`) then replace every
+     * argument matching its string with the run_id */
+    char run_id_buf[16];
+    if (cfg->run_id_str != NULL) {
+        (void)snprintf(run_id_buf, sizeof(run_id_buf),
+            "%zu", state.run_id);
+        for (int i = 1; i < target->argc; i++) {
+            if (0 == strcmp(target->argv[i], cfg->run_id_str)) {
+                target->argv[i] = run_id_buf;
             }
         }
+    }
+
+    (void)execvp(target->argv[0], &target->argv[0]);
+    warn("execvp");
+    _exit(1);
+}
 
-        int res = execvp(cfg->argv[0], &cfg->argv[0]);
-        if (res == -1) { err(1, "execvp"); }
-    } else {                   /* parent */
-        status->pid = kid;
-        status->run_id = id;
-        bool timed_out = false;
-        int stat_loc = supervise_process(status, &timed_out);
-        status->reason = REASON_UNDEF;
+/* Set the child's failure reason from its wait status.
+ * Returns whether it failed. */
+static bool check_status(struct child_status *status, int stat_loc,
+    bool timed_out) {
+    bool failed = false;
+    status->reason = REASON_UNDEF;
 #ifdef WCOREDUMP
-        status->dumped_core = WCOREDUMP(stat_loc);
+    status->dumped_core = WCOREDUMP(stat_loc);
 #endif
 
-        if (timed_out) {
-            status->reason = REASON_TIMEOUT;
-            failed = true;
-        } else if (WIFEXITED(stat_loc)) {
-            status->reason = REASON_EXIT;
-            status->exit_status = WEXITSTATUS(stat_loc);
-
-            /* Set failed if the exit_status isn't in the ignored set. */
-            failed = (0 == (cfg->ignored_exits[status->exit_status / 64]
-                    & (1LLU << (status->exit_status % 64))));
-        } else if (WIFSIGNALED(stat_loc)) {
-            status->reason = REASON_TERM;
-            status->term_signal = WTERMSIG(stat_loc);
-            failed = true;
-        } else if (WIFSTOPPED(stat_loc)) {
-            status->reason = REASON_STOP;
-            status->stop_signal = WSTOPSIG(stat_loc);
-            failed = true;
-        }
-
-        if (cfg->verbosity > 1) {
-            printf(" -- type: %s, core? %d, exit: %d, term: %d, stop: %d\n",
-                status->reason, status->dumped_core,
-                status->exit_status, status->term_signal,
-                status->stop_signal);
-        }
-
-        if (failed && cfg->error_handler != NULL) {
-            setenv_and_call_handler(status,
-                outlog != -1 ? outlogbuf : NULL,
-                errlog != -1 ? errlogbuf : NULL);
-        } else if (status->reason == REASON_TIMEOUT) {
-            int res = kill(kid, cfg->timeout_kill_signal);
-            if (res == -1) {
-                if (errno == ESRCH) {
-                    /* Race: child terminated on its own, as we
-                     * timed it out. Consider it a timeout. */
-                    errno = 0;
-                } else {
-                    err(1, "kill");
-                }
+    if (timed_out) {
+        status->reason = REASON_TIMEOUT;
+        failed = true;
+    } else if (WIFEXITED(stat_loc)) {
+        status->reason = REASON_EXIT;
+        status->exit_status = WEXITSTATUS(stat_loc);
+
+        /* Set failed if the exit_status isn't in the ignored set. */
+        failed = (0 == (target->ignored_exits[status->exit_status / 64]
+                & (1LLU << (status->exit_status % 64))));
+    } else if (WIFSIGNALED(stat_loc)) {
+        status->reason = REASON_TERM;
+        status->term_signal = WTERMSIG(stat_loc);
+        failed = true;
+    } else if (WIFSTOPPED(stat_loc)) {
+        status->reason = REASON_STOP;
+        status->stop_signal = WSTOPSIG(stat_loc);
+        failed = true;
+    }
+
+    if (cfg->verbosity > 1) {
+        printf(" -- type: %s, core? %d, exit: %d, term: %d, stop: %d\n",
+            status->reason, status->dumped_core,
+            status->exit_status, status->term_signal,
+            status->stop_signal);
+    }
+    return failed;
+}
+
+/* Save whatever the run's failure (or resource growth) calls for, then
+ * call the failure handler, or kill the child if it timed out. */
+static void handle_failure(struct child_status *status, bool failed,
+    bool timed_out, const struct run_paths *logs) {
+    const pid_t kid = status->pid;
+    const size_t id = status->run_id;
+    struct run_paths paths = *logs;
+
+    /* Snapshot a hung process tree before the handler or the
+     * kill signal can disturb it. */
+    char hangbuf[PATH_MAX];
+    if (timed_out && cfg->hang_detail != HANG_NONE) {
+        output_path(hangbuf, PATH_MAX, id, "hang", "", LOG_FAIL);
+        const uint64_t hang_start = trace_now();
+        if (hang_snapshot(kid, hangbuf, cfg->hang_detail)) {
+            paths.hang = hangbuf;
+        }
+        trace_phase("hang snapshot", hang_start);
+        if (paths.hang != NULL && cfg->verbosity > 0) {
+            printf(" -- hang snapshot: %s\n", hangbuf);
+        }
+    }
+
+    /* Only keep the resource samples for failing or flagged runs. */
+    char samplesbuf[PATH_MAX];
+    if (state.samples != NULL) {
+        if (cfg->flag_growth) {
+            status->growth = sample_growth(state.samples);
+        }
+        if (failed || status->growth != 0) {
+            output_path(samplesbuf, PATH_MAX, id, "samples", "",
+                failed ? LOG_FAIL : LOG_PASS);
+            if (sample_write(state.samples, samplesbuf, kid, id,
+                    status->growth)) {
+                paths.samples = samplesbuf;
             }
         }
+        if (status->growth != 0 && cfg->verbosity > 0) {
+            printf(" -- run %zu flagged:%s%s\n", id,
+                (status->growth & GROWTH_RSS) ? " RSS growing" : "",
+                (status->growth & GROWTH_FDS) ? " fds growing" : "");
+        }
     }
 
+    if (failed && cfg->error_handler != NULL) {
+        const uint64_t handler_start = trace_now();
+        setenv_and_call_handler(status, &paths);
+        trace_phase("handler", handler_start);
+    } else if (status->reason == REASON_TIMEOUT) {
+        int res = kill(kid, cfg->timeout_kill_signal);
+        if (res == -1) {
+            if (errno == ESRCH) {
+                /* Race: child terminated on its own, as we
+                 * timed it out. Consider it a timeout. */
+                errno = 0;
+            } else {
+                err(1, "kill");
+            }
+        }
+    }
+}
+
+/* Close the logs, mark them as passing or failing, and rotate out
+ * old ones. */
+static void finish_logs(struct target_state *ts, size_t id,
+    int outlog, int errlog, bool failed) {
+    const uint64_t finalize_start = trace_now();
+    size_t old_id = 0;
+    const bool rotate = (outlog != -1 || errlog != -1)
+        && rotation_push(ts, id, &old_id);
     if (outlog != -1) {
         close_log(outlog);
-        rename_log(tag_stdout, id, failed);
-        rotate_log(tag_stdout, id);
+        rename_log(TAG_STDOUT, id, failed);
+        if (rotate) { rotate_log(TAG_STDOUT, old_id); }
     }
     if (errlog != -1) {
         close_log(errlog);
-        rename_log(tag_stderr, id, failed);
-        rotate_log(tag_stderr, id);
+        rename_log(TAG_STDERR, id, failed);
+        if (rotate) { rotate_log(TAG_STDERR, old_id); }
+    }
+    if (outlog != -1 || errlog != -1) {
+        trace_phase("log finalize", finalize_start);
+    }
+}
+
+static void set_cloexec(int fd) {
+    const int flags = fcntl(fd, F_GETFD);
+    if (flags == -1 || -1 == fcntl(fd, F_SETFD, flags | FD_CLOEXEC)) {
+        err(1, "fcntl");
+    }
+}
+
+/* Start a new batch (-N) for the current target, whose first
+ * iteration will be run ID. */
+static void start_batch(struct iter_batch *b, size_t id) {
+    int control[2];
+    int report[2];
+    if (-1 == pipe(control) || -1 == pipe(report)) { err(1, "pipe"); }
+
+    /* Keep autoclave's ends out of the target, so it sees EOF once
+     * the control fd is closed. */
+    set_cloexec(control[1]);
+    set_cloexec(report[0]);
+    const int flags = fcntl(report[0], F_GETFL);
+    if (flags == -1 || -1 == fcntl(report[0], F_SETFL, flags | O_NONBLOCK)) {
+        err(1, "fcntl");
+    }
+
+    char logbuf[PATH_MAX];
+    b->outlog = cfg->log_stdout ? open_log(logbuf, id, TAG_STDOUT) : -1;
+    b->errlog = cfg->log_stderr ? open_log(logbuf, id, TAG_STDERR) : -1;
+
+    if (-1 == getrusage(RUSAGE_CHILDREN, &b->pre_usage)) {
+        err(1, "getrusage");
+    }
+    b->cpu_base = 0;
+    b->pid = spawn_child(b->outlog, b->errlog, control[0], report[1]);
+    (void)close(control[0]);
+    (void)close(report[1]);
+
+    b->target = (size_t)(target - cfg->targets);
+    b->first_id = id;
+    b->remaining = cfg->iterations;
+    b->control_fd = control[1];
+    b->report_fd = report[0];
+    b->report_len = 0;
+    b->failed = false;
+    b->reported = false;
+}
+
+static void close_control(struct iter_batch *b) {
+    if (b->control_fd == -1) { return; }
+    (void)close(b->control_fd);
+    b->control_fd = -1;
+}
+
+/* Clean up after a batch whose target has exited or timed out. Its
+ * logs are marked as failing if any of its iterations failed. */
+static void end_batch(struct target_state *ts, struct iter_batch *b) {
+    close_control(b);
+    if (b->report_fd != -1) {
+        (void)close(b->report_fd);
+        b->report_fd = -1;
+    }
+    finish_logs(ts, b->first_id, b->outlog, b->errlog, b->failed);
+    b->pid = 0;
+}
+
+/* Run one iteration of the current batch (-N) as run ID, starting a
+ * new batch first if necessary. A crash or timeout is attributed to
+ * whichever iteration is in progress, and ends the batch. */
+static bool try_iteration(struct target_state *ts, size_t id,
+    struct child_status *status) {
+    struct iter_batch *b = state.batch;
+    const uint64_t spawn_start = trace_now();
+    if (state.samples != NULL) { sample_reset(state.samples); }
+    if (b->pid == 0) {
+        start_batch(b, id);
+        trace_phase("spawn", spawn_start);
+    }
+    if (state.perf != NULL) { perf_begin(state.perf); }
+
+    status->pid = b->pid;
+    status->run_id = id;
+    b->started = false;
+    b->remaining--;
+    /* If the target has already exited, supervise_process will
+     * reap it below. */
+    (void)iter_send(b->control_fd, id);
+    if (b->remaining == 0) { close_control(b); }
+
+    bool timed_out = false;
+    bool exited = false;
+    const uint64_t supervise_start = trace_now();
+    int stat_loc = supervise_process(status, &timed_out, &exited);
+    trace_phase("supervise", supervise_start);
+
+    /* Charge the target's CPU time since the last iteration to this
+     * one. Once it has been reaped, only getrusage(2) has it. */
+    double cpu_total = b->cpu_base;
+    if (exited) {
+        cpu_total += child_cpu_msec(&b->pre_usage);
+    } else {
+        (void)proc_cpu_msec(b->pid, &cpu_total);
+    }
+    status->cpu_msec = cpu_total > b->cpu_base ? cpu_total - b->cpu_base : 0;
+    if (state.perf != NULL) { perf_end(state.perf); }
+
+    /* If it's still running, stop_batch will stop it. */
+    if (interrupted) {
+        if (exited) { end_batch(ts, b); }
+        return false;
+    }
+
+    if (status->report == ITER_NONE && b->started) {
+        struct timeval now;
+        cur_time(&now);
+        status->iter_msec = calc_duration(&b->start, &now);
+    }
+
+    bool failed = false;
+    if (exited || timed_out) {
+        failed = check_status(status, stat_loc, timed_out);
+    }
+    if (!failed && status->report == ITER_FAIL) {
+        status->reason = REASON_ITERATION;
+        failed = true;
+    } else if (!failed && exited && status->report == ITER_NONE
+        && (b->started || b->reported)) {
+        /* It uses the protocol, but exited without a result, e.g. by
+         * returning from main partway through an iteration. Only a
+         * target that ignores the protocol passes by exiting. */
+        status->reason = REASON_NO_RESULT;
+        failed = true;
+    }
+
+    char outlogbuf[PATH_MAX];
+    char errlogbuf[PATH_MAX];
+    struct run_paths paths = { .stdout_log = NULL };
+    if (b->outlog != -1) {
+        log_path(outlogbuf, PATH_MAX, b->first_id, TAG_STDOUT, LOG_RUNNING);
+        paths.stdout_log = outlogbuf;
+    }
+    if (b->errlog != -1) {
+        log_path(errlogbuf, PATH_MAX, b->first_id, TAG_STDERR, LOG_RUNNING);
+        paths.stderr_log = errlogbuf;
+    }
+    handle_failure(status, failed, timed_out, &paths);
+    if (failed) { b->failed = true; }
+
+    if (exited || timed_out) {
+        end_batch(ts, b);
+    } else {
+        /* Start counting the next iteration's CPU time after the
+         * handler, so getrusage(2) doesn't include it. */
+        b->cpu_base = cpu_total;
+        if (-1 == getrusage(RUSAGE_CHILDREN, &b->pre_usage)) {
+            err(1, "getrusage");
+        }
     }
     return failed;
 }
 
+/* Stop a batch that is still running once autoclave is done (-N). It
+ * won't be handed any more iterations, so it should exit; if it
+ * doesn't within the timeout, kill it. */
+static void stop_batch(void) {
+    struct iter_batch *b = state.batch;
+    if (b == NULL || b->pid == 0) { return; }
+    target = &cfg->targets[b->target];
+    close_control(b);
+
+    struct child_status status = { .pid = b->pid };
+    bool timed_out = false;
+    bool exited = false;
+    (void)supervise_process(&status, &timed_out, &exited);
+    if (timed_out || interrupted) { abandon_run(b->pid, exited); }
+    end_batch(&state.targets[b->target], b);
+}
+
+/* Stop a run that is being abandoned, because it timed out while
+ * stopping a batch or autoclave got SIGINT, if it's still going. */
+static void abandon_run(pid_t pid, bool exited) {
+    if (!exited && -1 == kill(pid, cfg->timeout_kill_signal)) {
+        if (errno != ESRCH) { err(1, "kill"); }
+        errno = 0;
+    }
+}
+
+/* CPU time used by children reaped since PRE was sampled, in msec.
+ * This is measured before the error handler can add its own. */
+static double child_cpu_msec(const struct rusage *pre) {
+    struct rusage post;
+    if (-1 == getrusage(RUSAGE_CHILDREN, &post)) { err(1, "getrusage"); }
+    const double pre_msec = 1000.0 * (pre->ru_utime.tv_sec
+        + pre->ru_stime.tv_sec)
+      + (pre->ru_utime.tv_usec + pre->ru_stime.tv_usec) / 1000.0;
+    const double post_msec = 1000.0 * (post.ru_utime.tv_sec
+        + post.ru_stime.tv_sec)
+      + (post.ru_utime.tv_usec + post.ru_stime.tv_usec) / 1000.0;
+    return post_msec > pre_msec ? post_msec - pre_msec : 0;
+}
+
 static void close_log(int fd) {
     if (-1 == close(fd)) { err(1, "close"); }
 }
@@ -444,44 +1029,126 @@ static void rename_log(const char *tag, size_t id, bool failed) {
     errno = 0;
     const int res = rename(oldlogbuf, newlogbuf);
     if (res == -1) { err(1, "rename"); }
+
+    /* Only compress it now, after the handler has had it. */
+    if (state.compress != NULL) {
+        (void)compress_log(state.compress, newlogbuf);
+    }
 }
 
-static void rotate_log(const char *tag, size_t id) {
-    if (cfg->rot.type == ROT_COUNT) {
-        const size_t count = cfg->rot.u.count.count;
-        char oldlogbuf[PATH_MAX];
-        /* Only rotate logs from passing runs */
-        log_path(oldlogbuf, PATH_MAX, id - count, tag, LOG_PASS);
-
-        if (id >= count) {
-            int res = unlink(oldlogbuf);
-            if (res == -1) {
-                if (errno == ENOENT) {
-                    /* Couldn't find file -- may not exist, or may
-                     * be a failure, which should probably be kept. */
-                    errno = 0;
-                } else {
-                    err(1, "unlink");
-                }
+/* Note that run ID was logged, and get the ID whose logs should be
+ * rotated out, if any. Run IDs are contiguous unless they come from a
+ * shared campaign, are split between several targets, or share logs
+ * in a batch (-N), in which case the target's last COUNT IDs are kept
+ * in a ring. */
+static bool rotation_push(struct target_state *ts, size_t id,
+    size_t *old_id) {
+    if (cfg->rot.type != ROT_COUNT) { return false; }
+    const size_t count = cfg->rot.u.count.count;
+
+    if (ts->rot_ring == NULL || count == 0) {
+        if (id < count) { return false; }
+        *old_id = id - count;
+        return true;
+    }
+
+    if (ts->rot_len < count) {
+        ts->rot_ring[ts->rot_len++] = id;
+        return false;
+    }
+    *old_id = ts->rot_ring[ts->rot_pos];
+    ts->rot_ring[ts->rot_pos] = id;
+    ts->rot_pos = (ts->rot_pos + 1) % count;
+    return true;
+}
+
+static void rotate_log(const char *tag, size_t old_id) {
+    char oldlogbuf[PATH_MAX];
+    /* Only rotate logs from passing runs */
+    log_path(oldlogbuf, PATH_MAX, old_id, tag, LOG_PASS);
+
+    /* It may still be queued for compression, so remove it (or its
+     * .gz) on the same queue, in order. */
+    if (state.compress != NULL) {
+        compress_unlink(state.compress, oldlogbuf);
+        return;
+    }
+
+    int res = unlink(oldlogbuf);
+    if (res == -1) {
+        if (errno == ENOENT) {
+            /* Couldn't find file -- may not exist, or may
+             * be a failure, which should probably be kept. */
+            errno = 0;
+        } else {
+            err(1, "unlink");
+        }
+    }
+}
+
+/* Read the target's reports on the current iteration (-N).
+ * Returns true once its result is in. */
+static bool read_reports(struct iter_batch *b, struct child_status *status) {
+    if (b->report_fd != -1 && !iter_fill(b)) {
+        (void)close(b->report_fd);
+        b->report_fd = -1;
+    }
+
+    enum iter_report rep;
+    size_t id;
+    while (status->report == ITER_NONE
+        && (rep = iter_next_report(b, &id)) != ITER_NONE) {
+        b->reported = true;
+        if (id != status->run_id) {
+            warnx("ignoring report for run %zu during run %zu",
+                id, status->run_id);
+            continue;
+        }
+        struct timeval now;
+        cur_time(&now);
+        if (rep == ITER_START) {
+            b->started = true;
+            b->start = now;
+        } else {
+            status->report = rep;
+            if (b->started) {
+                status->iter_msec = calc_duration(&b->start, &now);
             }
         }
     }
+    return status->report != ITER_NONE;
 }
 
-static int supervise_process(struct child_status *status, bool *timed_out) {
+/* Wait for the child to exit or time out. With -N, also return once
+ * the current iteration's result is in, unless it is the batch's last
+ * iteration, which waits for the target to exit. */
+static int supervise_process(struct child_status *status, bool *timed_out,
+    bool *exited) {
+    struct iter_batch *b = state.batch;
     int stat_loc = 0;
-    size_t ticks = 0;
     const int sleep_msec = 100;
-    const size_t max_ticks = (size_t)cfg->timeout_sec * (1000 / sleep_msec);
+    const double timeout_msec = 1000.0 * target->timeout_sec;
+    /* Not at 0: until it execs, the child is still autoclave. */
+    double next_sample_msec = cfg->sample_msec;
+    struct timeval start, now;
+    cur_time(&start);
     
     struct pollfd fds[] = {
         {
             .fd = alert_rd_pipe,
             .events = POLLIN,
         },
+        {
+            .fd = -1,
+            .events = POLLIN,
+        },
     };
     
-    while (ticks < max_ticks) {
+    for (;;) {
+        if (b != NULL && read_reports(b, status) && b->control_fd != -1) {
+            break;
+        }
+
         /* Poll for child process termination. */
         const pid_t res = waitpid(status->pid, &stat_loc, WNOHANG);
         if (res == -1) {
@@ -491,9 +1158,41 @@ static int supervise_process(struct child_status *status, bool *timed_out) {
                 err(1, "wait");
             }
         } else if (res == 0) {
-            /* Sleep 100 msec, unless a SIGCHLD wakes it up. */
-            const int poll_res = poll(fds, 1, sleep_msec);
-            if (poll_res == 1) {
+            if (interrupted) { break; }
+            cur_time(&now);
+            const double elapsed = calc_duration(&start, &now);
+            double wait_msec = sleep_msec;
+
+            if (target->timeout_sec != NO_TIMEOUT) {
+                if (elapsed >= timeout_msec) {
+                    *timed_out = true;
+                    break;
+                }
+                if (timeout_msec - elapsed < wait_msec) {
+                    wait_msec = timeout_msec - elapsed;
+                }
+            }
+
+            if (state.samples != NULL) {
+                if (elapsed >= next_sample_msec) {
+                    (void)sample_take(state.samples, status->pid,
+                        cfg->sample_descendants, (uint32_t)elapsed);
+                    next_sample_msec += cfg->sample_msec;
+                    /* If sampling fell behind, skip ahead. */
+                    if (next_sample_msec < elapsed) {
+                        next_sample_msec = elapsed + cfg->sample_msec;
+                    }
+                }
+                if (next_sample_msec - elapsed < wait_msec) {
+                    wait_msec = next_sample_msec - elapsed;
+                }
+            }
+
+            /* Sleep until the next timeout/sample check is due, or
+             * 100 msec, unless a SIGCHLD or a report wakes it up. */
+            fds[1].fd = b != NULL ? b->report_fd : -1;
+            const int poll_res = poll(fds, 2, (int)wait_msec + 1);
+            if (poll_res > 0 && (fds[0].revents & POLLIN)) {
                 char buf[8];
                 ssize_t rd = read(alert_rd_pipe, buf, sizeof(buf));
                 if (rd >= 0) {
@@ -506,19 +1205,20 @@ static int supervise_process(struct child_status *status, bool *timed_out) {
                     }
                 }
             }
-            if (cfg->timeout_sec != NO_TIMEOUT) { ticks++; }
         } else {
             assert(res == status->pid);
+            *exited = true;
             break;
         }
     }
 
-    if (ticks == max_ticks) { *timed_out = true; }
+    /* Pick up any reports written just before the target exited. */
+    if (b != NULL && *exited) { (void)read_reports(b, status); }
     return stat_loc;
 }
 
 static void setenv_and_call_handler(struct child_status *status,
-    char *stdout_log_path, char *stderr_log_path) {
+    const struct run_paths *paths) {
     setenv("AUTOCLAVE_DUMPED_CORE",
         status->dumped_core ? "1" : "0", 1);
     setenv("AUTOCLAVE_FAIL_TYPE", status->reason, 1);
@@ -544,13 +1244,36 @@ static void setenv_and_call_handler(struct child_status *status,
     if (sz >= snprintf(id_buf, sz, "%d", (int)status->run_id)) {
         setenv("AUTOCLAVE_RUN_ID", id_buf, 1);
     }
-    setenv("AUTOCLAVE_CMD", cfg->argv[0], 1);
+    setenv("AUTOCLAVE_CMD", target->argv[0], 1);
+    setenv("AUTOCLAVE_TARGET", target->name, 1);
 
-    if (stdout_log_path) {
-        setenv("AUTOCLAVE_STDOUT_LOG", stdout_log_path, 1);
+    if (paths->stdout_log) {
+        setenv("AUTOCLAVE_STDOUT_LOG", paths->stdout_log, 1);
+    }
+    if (paths->stderr_log) {
+        setenv("AUTOCLAVE_STDERR_LOG", paths->stderr_log, 1);
     }
-    if (stderr_log_path) {
-        setenv("AUTOCLAVE_STDERR_LOG", stderr_log_path, 1);
+    if (paths->hang) {
+        setenv("AUTOCLAVE_HANG_LOG", paths->hang, 1);
+    } else {
+        unsetenv("AUTOCLAVE_HANG_LOG");
+    }
+    if (paths->samples) {
+        setenv("AUTOCLAVE_SAMPLES_LOG", paths->samples, 1);
+    } else {
+        unsetenv("AUTOCLAVE_SAMPLES_LOG");
+    }
+    if (state.perf != NULL) {
+        for (int c = 0; c < PERF_CTR_COUNT; c++) {
+            double value;
+            if (perf_last(state.perf, c, &value)) {
+                char buf[32];
+                snprintf(buf, sizeof(buf), "%.15g", value);
+                setenv(perf_env_name(c), buf, 1);
+            } else {
+                unsetenv(perf_env_name(c));
+            }
+        }
     }
 
     if (-1 == system(cfg->error_handler)) {
@@ -581,38 +1304,180 @@ static double calc_duration(const struct timeval *pre,
           + (post->tv_usec - pre->tv_usec)/1000.0);
 }
 
+/* Current time in usec since the campaign started, if tracing. */
+static uint64_t trace_now(void) {
+    if (state.trace == NULL) { return 0; }
+    struct timeval now;
+    cur_time(&now);
+    return (uint64_t)(1000.0 * calc_duration(&state.start_time, &now));
+}
+
+/* Record a span for one of the current run's phases, from START_USEC
+ * (from trace_now) until now. */
+static void trace_phase(const char *name, uint64_t start_usec) {
+    if (state.trace == NULL) { return; }
+    trace_span(state.trace, name, start_usec, trace_now(),
+        state.run_id, target->name);
+}
+
+/* Minimum interval between samples of the runs/sec counter. */
+#define TRACE_RATE_INTERVAL_USEC 250000
+
+/* Record the end of a run, update the counter tracks, and write out
+ * the buffered events if enough have accumulated. */
+static void trace_end_run(uint64_t start_usec, bool failed) {
+    struct trace *t = state.trace;
+    if (t == NULL) { return; }
+    const uint64_t end = trace_now();
+    trace_run(t, start_usec, end, state.run_id, target->name, failed);
+    if (failed || state.runs == 1) {
+        trace_counter(t, "failures", end, state.failures);
+    }
+
+    static uint64_t last_rate_usec;
+    static size_t last_rate_runs;
+    if (end - last_rate_usec >= TRACE_RATE_INTERVAL_USEC) {
+        const double rate = (state.runs - last_rate_runs)
+            / ((end - last_rate_usec) / 1e6);
+        trace_counter(t, "runs/sec", end, rate);
+        last_rate_usec = end;
+        last_rate_runs = state.runs;
+    }
+
+    if (trace_maybe_flush(t)) { trace_phase("trace flush", end); }
+}
+
+static void close_trace(void) {
+    trace_close(state.trace);
+    state.trace = NULL;
+}
+
+/* Get the next run's ID, or return false if the run limit
+ * has been reached (or a shared campaign has stopped). */
+static bool next_run_id(size_t *id) {
+    if (state.campaign != NULL) {
+        return campaign_claim_run(state.campaign, id);
+    }
+    if (state.run_id >= cfg->max_runs) { return false; }
+    *id = state.run_id + 1;
+    return true;
+}
+
+/* Choose which target to run next. */
+static size_t pick_target(void) {
+    /* Keep feeding a running batch until it's done. */
+    if (state.batch != NULL && state.batch->pid != 0) {
+        return state.batch->target;
+    }
+    if (cfg->target_count == 1) { return 0; }
+    return sched_pick(state.arms, cfg->target_count);
+}
+
+/* Count a finished run. Returns true if the failure limit has been
+ * reached, either locally or across a shared campaign. */
+static bool record_run(bool failed) {
+    if (failed) { state.failures++; }
+    if (state.campaign != NULL) {
+        return campaign_record_run(state.campaign, failed);
+    }
+    return state.failures >= cfg->max_failures;
+}
+
+static int exit_status(void) {
+    if (state.campaign != NULL) {
+        struct campaign_totals totals;
+        campaign_totals(state.campaign, &totals);
+        if (totals.failures > 0) { return EXIT_FAILURE; }
+    }
+    if (state.regress != NULL && state.regress->verdict == REGRESS_SLOWER) {
+        return EXIT_FAILURE;
+    }
+    return state.failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 static int mainloop(void) {
     cur_time(&state.start_time);
 
-    while (state.run_id < cfg->max_runs) {
+    size_t id;
+    while (!interrupted && next_run_id(&id)) {
         struct timeval pre, post;
         struct child_status s;
-        state.run_id++;
+        const size_t ti = pick_target();
+        struct target_state *ts = &state.targets[ti];
+        target = &cfg->targets[ti];
+        state.run_id = id;
+        state.runs++;
+        const uint64_t run_start = trace_now();
         cur_time(&pre);
-        bool failed = try_exec(state.run_id, &s);
+        bool failed = try_exec(ts, id, &s);
         cur_time(&post);
-        if (failed) { state.failures++; }
-        if (state.failures >= cfg->max_failures) { break; }
 
-        const double duration_msec = calc_duration(&pre, &post);
+        /* Don't count a run cut short by SIGINT. */
+        if (interrupted) {
+            state.runs--;
+            break;
+        }
+
+        /* With -N, time the iteration itself, as reported by the
+         * target, rather than the round trip to it. */
+        const double duration_msec = s.iter_msec > 0
+          ? s.iter_msec : calc_duration(&pre, &post);
+        ts->runs++;
+        if (failed) { ts->failures++; }
+        if (s.growth != 0) { state.flagged++; }
+        ts->total_msec += duration_msec;
+        if (cfg->target_count > 1) { sched_update(&state.arms[ti], failed); }
+
+        const bool done = record_run(failed);
+        trace_end_run(run_start, failed);
+        if (done) { break; }
+
+        /* Only passing runs are compared: failures and timeouts
+         * would skew the distribution. */
+        if (state.regress != NULL && !failed) {
+            regress_add(state.regress, duration_msec, s.cpu_msec);
+            if (regress_check(state.regress, false) != REGRESS_UNDECIDED) {
+                break;
+            }
+        }
 
         if (cfg->verbosity > 0) {
-            printf("%08lld.%06lld -- %zd run%s, %zd failure%s, %g msec\n",
+            printf("%08lld.%06lld -- %zd run%s, %zd failure%s, %g msec%s%s\n",
                 (long long)post.tv_sec, (long long)post.tv_usec,
-                state.run_id, state.run_id == 1 ? "" : "s",
+                state.runs, state.runs == 1 ? "" : "s",
                 state.failures, state.failures == 1 ? "" : "s",
-                duration_msec);
+                duration_msec,
+                cfg->target_count > 1 ? ", " : "",
+                cfg->target_count > 1 ? target->name : "");
         }
 
         /* If the run did not take at least the minimum duration, then
-         * wait, to pad the overall run time to the minimum. */
-        if (duration_msec < cfg->min_duration_msec) {
+         * wait, to pad the overall run time to the minimum. With -N,
+         * this only applies between execs. */
+        const bool in_batch = state.batch != NULL && state.batch->pid != 0;
+        if (duration_msec < cfg->min_duration_msec && !in_batch) {
             const size_t rem = cfg->min_duration_msec - duration_msec;
+            const uint64_t pad_start = trace_now();
             poll(NULL, 0, (int)rem);
+            trace_phase("pad", pad_start);
         }
     }
+    stop_batch();
     print_stats();
-    return state.failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    finish_regress();
+    return exit_status();
+}
+
+/* Make a final regression check, report it, and save the baseline. */
+static void finish_regress(void) {
+    if (state.regress == NULL) { return; }
+    if (state.regress->verdict == REGRESS_UNDECIDED) {
+        (void)regress_check(state.regress, true);
+    }
+    regress_report(state.regress, stdout);
+    if (cfg->baseline_save_path != NULL) {
+        regress_save(state.regress, cfg->baseline_save_path);
+    }
 }
 
 static void init_sigchild_alert(void) {
@@ -629,6 +1494,15 @@ static void init_sigchild_alert(void) {
     }
 }
 
+static void init_sigpipe_handler(void) {
+    struct sigaction sa = {
+        .sa_handler = sigpipe_handler,
+    };
+    if (sigaction(SIGPIPE, &sa, NULL) == -1) {
+        err(1, "sigaction");
+    }
+}
+
 static void init_sigint_handler(void) {
     struct sigaction sa = {
         .sa_handler = sigint_handler,
@@ -639,16 +1513,59 @@ static void init_sigint_handler(void) {
 }
 
 static void print_stats(void) {
-    const size_t passes = state.run_id - state.failures;
+    const size_t passes = state.runs - state.failures;
     struct timeval post;
     cur_time(&post);
     double duration = calc_duration(&state.start_time, &post);
 
     printf("-- %zu run%s, %zu pass%s, %zu failure%s, %g msec\n",
-        state.run_id, state.run_id == 1 ? "" : "s",
+        state.runs, state.runs == 1 ? "" : "s",
         passes, passes == 1 ? "" : "es",
         state.failures, state.failures == 1 ? "" : "s",
         duration);
+
+    if (cfg->flag_growth) {
+        printf("-- %zu run%s flagged for RSS or fd growth\n",
+            state.flagged, state.flagged == 1 ? "" : "s");
+    }
+
+    if (cfg->target_count > 1) {
+        for (size_t i = 0; i < cfg->target_count; i++) {
+            const struct target_state *ts = &state.targets[i];
+            printf("--   %s: %zu run%s, %zu failure%s, "
+                "mean %g msec, recent failure rate %.3g\n",
+                cfg->targets[i].name, ts->runs, ts->runs == 1 ? "" : "s",
+                ts->failures, ts->failures == 1 ? "" : "s",
+                ts->runs > 0 ? ts->total_msec / ts->runs : 0,
+                sched_failure_rate(&state.arms[i]));
+        }
+    }
+
+    if (state.perf != NULL) { perf_report(state.perf, stdout); }
+
+    if (state.campaign != NULL) {
+        struct campaign_totals t;
+        campaign_totals(state.campaign, &t);
+        printf("-- campaign: %llu run%s, %llu failure%s, "
+            "%llu instance%s (%llu active)%s\n",
+            (unsigned long long)t.runs_finished,
+            t.runs_finished == 1 ? "" : "s",
+            (unsigned long long)t.failures, t.failures == 1 ? "" : "s",
+            (unsigned long long)t.instances, t.instances == 1 ? "" : "s",
+            (unsigned long long)t.instances_active,
+            t.stopped ? ", stopped" : "");
+    }
+}
+
+/* Wait for any queued logs to be compressed. */
+static void close_compress(void) {
+    compress_finish(state.compress, stdout);
+    state.compress = NULL;
+}
+
+static void close_campaign(void) {
+    campaign_close(state.campaign);
+    state.campaign = NULL;
 }
 
 int main(int argc, char **argv) {
@@ -661,15 +1578,83 @@ int main(int argc, char **argv) {
         .min_duration_msec = DEF_MIN_DURATION_MSEC,
         .timeout_sec = NO_TIMEOUT,
         .timeout_kill_signal = SIGTERM,
+        .regress_threshold_pct = DEF_REGRESS_THRESHOLD_PCT,
     };
     config.ignored_exits[0] |= 1; /* exit of 0 is always ignored */
     handle_args(&config, argc, argv);
+
+    if (config.baseline_path != NULL || config.baseline_save_path != NULL) {
+        state.regress = calloc(1, sizeof(*state.regress));
+        if (state.regress == NULL) { err(1, "calloc"); }
+        state.regress->metric = config.regress_metric;
+        state.regress->threshold_pct = config.regress_threshold_pct;
+    }
+    if (config.baseline_path != NULL) {
+        regress_load_baseline(state.regress, config.baseline_path);
+        /* Without -r, stop after a multiple of the baseline's runs,
+         * even if the comparison is still inconclusive. */
+        if (config.max_runs == NO_LIMIT) {
+            config.max_runs = DEF_REGRESS_RUN_FACTOR
+                * state.regress->base_wall.count;
+        }
+    }
+    if (config.sample_msec > 0 && !sample_supported()) {
+        warnx("resource sampling (-P, -D, -G) is only supported on Linux");
+        config.sample_msec = 0;
+        config.flag_growth = false;
+    }
     cfg = &config;              /* After this point, cfg is const */
 
+    if (cfg->campaign_path != NULL) {
+        state.campaign = campaign_open(cfg->campaign_path,
+            cfg->max_runs, cfg->max_failures);
+        if (0 != atexit(close_campaign)) { err(1, "atexit"); }
+    }
+
+    if (cfg->sample_msec > 0) {
+        state.samples = calloc(1, sizeof(*state.samples));
+        if (state.samples == NULL) { err(1, "calloc"); }
+    }
+
+    if (cfg->perf_counters) { state.perf = perf_open(); }
+
+    if (cfg->compress_logs && (cfg->log_stdout || cfg->log_stderr)) {
+        state.compress = compress_start();
+        if (0 != atexit(close_compress)) { err(1, "atexit"); }
+    }
+
+    if (cfg->iterations > 0) {
+        state.batch = calloc(1, sizeof(*state.batch));
+        if (state.batch == NULL) { err(1, "calloc"); }
+    }
+
+    if (cfg->trace_path != NULL) {
+        state.trace = trace_open(cfg->trace_path);
+        if (0 != atexit(close_trace)) { err(1, "atexit"); }
+    }
+
+    state.targets = calloc(cfg->target_count, sizeof(*state.targets));
+    state.arms = calloc(cfg->target_count, sizeof(*state.arms));
+    if (state.targets == NULL || state.arms == NULL) { err(1, "calloc"); }
+    if (cfg->rot.type == ROT_COUNT && cfg->rot.u.count.count > 0
+        && (state.campaign != NULL || cfg->target_count > 1
+            || cfg->iterations > 0)) {
+        for (size_t i = 0; i < cfg->target_count; i++) {
+            size_t *ring = calloc(cfg->rot.u.count.count, sizeof(size_t));
+            if (ring == NULL) { err(1, "calloc"); }
+            state.targets[i].rot_ring = ring;
+        }
+    }
+
     init_sigchild_alert();
     init_sigint_handler();
+    if (cfg->iterations > 0) { init_sigpipe_handler(); }
 
     int res = mainloop();
+
+    /* Leave the campaign now, rather than waiting for atexit; that
+     * only covers the paths that exit early. */
+    close_campaign();
     cfg = NULL;
     return res;
 }
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2015-18 Scott Vokes <vokes.s@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE             /* syscall(2) */
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <err.h>
+#include <errno.h>
+
+#include "perf.h"
+#include "stats.h"
+
+static const struct {
+    const char *name;
+    const char *env;
+} names[PERF_CTR_COUNT] = {
+    [PERF_CTR_TASK_CLOCK] =
+    { "task-clock (msec)", "AUTOCLAVE_PERF_TASK_CLOCK_MSEC" },
+    [PERF_CTR_CONTEXT_SWITCHES] =
+    { "context-switches", "AUTOCLAVE_PERF_CONTEXT_SWITCHES" },
+    [PERF_CTR_CPU_MIGRATIONS] =
+    { "cpu-migrations", "AUTOCLAVE_PERF_CPU_MIGRATIONS" },
+    [PERF_CTR_PAGE_FAULTS] =
+    { "page-faults", "AUTOCLAVE_PERF_PAGE_FAULTS" },
+    [PERF_CTR_INSTRUCTIONS] =
+    { "instructions", "AUTOCLAVE_PERF_INSTRUCTIONS" },
+    [PERF_CTR_CYCLES] =
+    { "cycles", "AUTOCLAVE_PERF_CYCLES" },
+    [PERF_CTR_CACHE_MISSES] =
+    { "cache-misses", "AUTOCLAVE_PERF_CACHE_MISSES" },
+    [PERF_CTR_BRANCH_MISSES] =
+    { "branch-misses", "AUTOCLAVE_PERF_BRANCH_MISSES" },
+};
+
+const char *perf_env_name(enum perf_counter c) {
+    return names[c].env;
+}
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+    double scale;               /* e.g. task-clock is in nsec */
+} events[PERF_CTR_COUNT] = {
+    [PERF_CTR_TASK_CLOCK] =
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, 1e-6 },
+    [PERF_CTR_CONTEXT_SWITCHES] =
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, 1 },
+    [PERF_CTR_CPU_MIGRATIONS] =
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS, 1 },
+    [PERF_CTR_PAGE_FAULTS] =
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, 1 },
+    [PERF_CTR_INSTRUCTIONS] =
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 1 },
+    [PERF_CTR_CYCLES] =
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 1 },
+    [PERF_CTR_CACHE_MISSES] =
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, 1 },
+    [PERF_CTR_BRANCH_MISSES] =
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, 1 },
+};
+
+/* Layout of a read(2) with the read_format below. */
+struct reading {
+    uint64_t value;
+    uint64_t time_enabled;
+    uint64_t time_running;
+};
+
+struct perf {
+    int fd[PERF_CTR_COUNT];     /* -1 if unavailable */
+    struct reading pre[PERF_CTR_COUNT];
+    bool have_last[PERF_CTR_COUNT];
+    double last[PERF_CTR_COUNT];
+    struct samples runs[PERF_CTR_COUNT];
+};
+
+static int open_counter(enum perf_counter c, bool exclude_kernel) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[c].type;
+    attr.config = events[c].config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+        | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.enable_on_exec = 1;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = exclude_kernel;
+
+#ifdef PERF_FLAG_FD_CLOEXEC
+    const unsigned long flags = PERF_FLAG_FD_CLOEXEC;
+#else
+    const unsigned long flags = 0;
+#endif
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, flags);
+    if (fd != -1 && flags == 0) {
+        (void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+}
+
+static bool read_counter(int fd, struct reading *r) {
+    ssize_t rd = read(fd, r, sizeof(*r));
+    return rd == (ssize_t)sizeof(*r);
+}
+
+struct perf *perf_open(void) {
+    struct perf *p = calloc(1, sizeof(*p));
+    if (p == NULL) { err(1, "calloc"); }
+
+    size_t opened = 0;
+    for (int c = 0; c < PERF_CTR_COUNT; c++) {
+        /* Count kernel time too, if allowed; otherwise (e.g. with
+         * perf_event_paranoid >= 2), settle for user space. */
+        p->fd[c] = open_counter(c, false);
+        if (p->fd[c] == -1 && (errno == EACCES || errno == EPERM)) {
+            p->fd[c] = open_counter(c, true);
+        }
+        if (p->fd[c] != -1) { opened++; }
+        errno = 0;
+    }
+
+    if (opened == 0) {
+        warnx("perf counters (-E) are unavailable, "
+            "check /proc/sys/kernel/perf_event_paranoid");
+        free(p);
+        return NULL;
+    }
+    if (p->fd[PERF_CTR_INSTRUCTIONS] == -1 && p->fd[PERF_CTR_CYCLES] == -1) {
+        warnx("hardware perf counters are unavailable, "
+            "using software counters only");
+    }
+    return p;
+}
+
+void perf_begin(struct perf *p) {
+    for (int c = 0; c < PERF_CTR_COUNT; c++) {
+        if (p->fd[c] == -1) { continue; }
+        if (!read_counter(p->fd[c], &p->pre[c])) {
+            memset(&p->pre[c], 0, sizeof(p->pre[c]));
+        }
+    }
+}
+
+void perf_end(struct perf *p) {
+    for (int c = 0; c < PERF_CTR_COUNT; c++) {
+        p->have_last[c] = false;
+        struct reading post;
+        if (p->fd[c] == -1 || !read_counter(p->fd[c], &post)) { continue; }
+
+        const struct reading *pre = &p->pre[c];
+        const double value = (double)(post.value - pre->value);
+        const double enabled = (double)(post.time_enabled - pre->time_enabled);
+        const double running = (double)(post.time_running - pre->time_running);
+        if (running == 0) { continue; }  /* never got scheduled */
+
+        /* If the counter was multiplexed with others, extrapolate. */
+        double v = value * events[c].scale;
+        if (running < enabled) { v *= enabled / running; }
+        p->last[c] = v;
+        p->have_last[c] = true;
+        samples_push(&p->runs[c], v);
+    }
+}
+
+bool perf_last(const struct perf *p, enum perf_counter c, double *value) {
+    if (!p->have_last[c]) { return false; }
+    *value = p->last[c];
+    return true;
+}
+
+void perf_report(const struct perf *p, FILE *out) {
+    fprintf(out, "-- perf counters, per run:\n");
+    fprintf(out, "--   %-20s %14s %14s %14s\n", "", "p50", "p90", "p99");
+    for (int c = 0; c < PERF_CTR_COUNT; c++) {
+        const struct samples *s = &p->runs[c];
+        if (p->fd[c] == -1 || s->count == 0) { continue; }
+        fprintf(out, "--   %-20s %14.6g %14.6g %14.6g\n", names[c].name,
+            samples_percentile(s, 50), samples_percentile(s, 90),
+            samples_percentile(s, 99));
+    }
+}
+
+void perf_close(struct perf *p) {
+    if (p == NULL) { return; }
+    for (int c = 0; c < PERF_CTR_COUNT; c++) {
+        if (p->fd[c] != -1) { (void)close(p->fd[c]); }
+        samples_free(&p->runs[c]);
+    }
+    free(p);
+}
+
+#else
+
+struct perf *perf_open(void) {
+    warnx("perf counters (-E) are only supported on Linux");
+    return NULL;
+}
+
+void perf_begin(struct perf *p) { (void)p; }
+void perf_end(struct perf *p) { (void)p; }
+
+bool perf_last(const struct perf *p, enum perf_counter c, double *value) {
+    (void)p;
+    (void)c;
+    (void)value;
+    return false;
+}
+
+void perf_report(const struct perf *p, FILE *out) {
+    (void)p;
+    (void)out;
+}
+
+void perf_close(struct perf *p) { (void)p; }
+
+#endif
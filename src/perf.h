@@ -0,0 +1,52 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/* Per-run performance counters, via perf_event_open(2). The counters
+ * are opened on autoclave itself, disabled, and inherited by each
+ * child, which enables its copy when it execs -- so only the
+ * supervised program and its descendants are counted, not autoclave's
+ * own work between runs. (Linux only.) */
+
+enum perf_counter {
+    PERF_CTR_TASK_CLOCK,        /* software events */
+    PERF_CTR_CONTEXT_SWITCHES,
+    PERF_CTR_CPU_MIGRATIONS,
+    PERF_CTR_PAGE_FAULTS,
+    PERF_CTR_INSTRUCTIONS,      /* hardware events, if there's a PMU */
+    PERF_CTR_CYCLES,
+    PERF_CTR_CACHE_MISSES,
+    PERF_CTR_BRANCH_MISSES,
+    PERF_CTR_COUNT,
+};
+
+struct perf;
+
+/* Open the counters. Hardware counters that can't be opened (e.g. in
+ * a VM without a PMU) are skipped. Returns NULL, after a warning, if
+ * no counters could be opened at all. */
+struct perf *perf_open(void);
+
+/* Note the counters' current values, before starting a run. */
+void perf_begin(struct perf *p);
+
+/* Collect the counts since perf_begin, once the run is over. Exited
+ * children's counts are folded into ours when they are reaped; any
+ * still running (e.g. after a timeout) are read as of now. */
+void perf_end(struct perf *p);
+
+/* Get counter C's value for the last run, scaled up if the kernel had
+ * to multiplex it. Returns false if it isn't available. */
+bool perf_last(const struct perf *p, enum perf_counter c, double *value);
+
+/* Name of counter C's environment variable for the failure handler. */
+const char *perf_env_name(enum perf_counter c);
+
+/* Print percentiles of every counter over all runs so far. */
+void perf_report(const struct perf *p, FILE *out);
+
+void perf_close(struct perf *p);
+
+#endif
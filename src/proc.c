@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2015-18 Scott Vokes <vokes.s@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "proc.h"
+
+ssize_t proc_read_file(const char *path, char *buf, size_t size) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) { return -1; }
+    size_t used = 0;
+    while (used < size - 1) {
+        ssize_t rd = read(fd, &buf[used], size - 1 - used);
+        if (rd == -1) {
+            if (errno == EINTR) { continue; }
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return -1;
+        } else if (rd == 0) {
+            break;
+        }
+        used += rd;
+    }
+    buf[used] = '\0';
+    close(fd);
+    return used;
+}
+
+bool proc_parse_stat(const char *path, char *comm, size_t comm_size,
+    char *state, pid_t *ppid) {
+    char buf[1024];
+    if (proc_read_file(path, buf, sizeof(buf)) <= 0) { return false; }
+
+    /* The comm field can contain spaces and parens,
+     * so scan from the last ')'. */
+    char *open_paren = strchr(buf, '(');
+    char *close_paren = strrchr(buf, ')');
+    if (open_paren == NULL || close_paren == NULL
+        || close_paren < open_paren) {
+        return false;
+    }
+
+    if (comm != NULL) {
+        size_t len = close_paren - open_paren - 1;
+        if (len >= comm_size) { len = comm_size - 1; }
+        memcpy(comm, open_paren + 1, len);
+        comm[len] = '\0';
+    }
+
+    char st = '?';
+    int pp = 0;
+    if (2 != sscanf(close_paren + 1, " %c %d", &st, &pp)) { return false; }
+    if (state != NULL) { *state = st; }
+    if (ppid != NULL) { *ppid = pp; }
+    return true;
+}
+
+bool proc_cpu_msec(pid_t pid, double *msec) {
+    char path[64];
+    char buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    if (proc_read_file(path, buf, sizeof(buf)) <= 0) { return false; }
+
+    /* utime and stime are fields 14 and 15, in clock ticks. */
+    const char *close_paren = strrchr(buf, ')');
+    unsigned long utime, stime;
+    if (close_paren == NULL || 2 != sscanf(close_paren + 1,
+            " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+            &utime, &stime)) {
+        return false;
+    }
+    const long hz = sysconf(_SC_CLK_TCK);
+    *msec = 1000.0 * (utime + stime) / (hz > 0 ? hz : 100);
+    return true;
+}
+
+bool proc_is_numeric(const char *s) {
+    if (*s == '\0') { return false; }
+    for (; *s; s++) {
+        if (!isdigit((unsigned char)*s)) { return false; }
+    }
+    return true;
+}
+
+static void push(struct proc_table *t, pid_t pid, pid_t ppid) {
+    if (t->count == t->ceil) {
+        size_t nceil = t->ceil == 0 ? 64 : 2 * t->ceil;
+        struct proc_entry *n = realloc(t->entries, nceil * sizeof(*n));
+        if (n == NULL) { err(1, "realloc"); }
+        t->entries = n;
+        t->ceil = nceil;
+    }
+    t->entries[t->count].pid = pid;
+    t->entries[t->count].ppid = ppid;
+    t->count++;
+}
+
+void proc_scan(struct proc_table *t) {
+    t->count = 0;
+    DIR *d = opendir("/proc");
+    if (d == NULL) {
+        errno = 0;
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (!proc_is_numeric(de->d_name)) { continue; }
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%.32s/stat", de->d_name);
+        pid_t ppid;
+        if (!proc_parse_stat(path, NULL, 0, NULL, &ppid)) { continue; }
+        push(t, (pid_t)strtol(de->d_name, NULL, 10), ppid);
+    }
+    closedir(d);
+    errno = 0;
+}
+
+static bool in_table(const struct proc_table *t, pid_t pid) {
+    for (size_t i = 0; i < t->count; i++) {
+        if (t->entries[i].pid == pid) { return true; }
+    }
+    return false;
+}
+
+void proc_tree(const struct proc_table *all, pid_t root, pid_t root_ppid,
+    struct proc_table *tree) {
+    tree->count = 0;
+    push(tree, root, root_ppid);
+
+    /* The scan isn't atomic, so PID reuse can make the ppid links
+     * form a cycle. Queue each PID at most once, which also bounds
+     * the tree at all->count + 1 entries. */
+    for (size_t head = 0; head < tree->count; head++) {
+        const pid_t cur = tree->entries[head].pid;
+        for (size_t i = 0; i < all->count; i++) {
+            const pid_t pid = all->entries[i].pid;
+            if (all->entries[i].ppid == cur && !in_table(tree, pid)) {
+                push(tree, pid, cur);
+            }
+        }
+    }
+}
+
+void proc_table_free(struct proc_table *t) {
+    free(t->entries);
+    t->entries = NULL;
+    t->count = 0;
+    t->ceil = 0;
+}
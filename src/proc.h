@@ -0,0 +1,46 @@
+#ifndef PROC_H
+#define PROC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Helpers for reading process information from /proc (on Linux).
+ * Elsewhere, these fail as if the processes didn't exist. */
+
+struct proc_entry {
+    pid_t pid;
+    pid_t ppid;
+};
+
+struct proc_table {
+    size_t count;
+    size_t ceil;
+    struct proc_entry *entries;
+};
+
+/* Read up to size - 1 bytes of a (small) /proc file into buf,
+ * NUL-terminated. Returns the length read, or -1 with errno set. */
+ssize_t proc_read_file(const char *path, char *buf, size_t size);
+
+/* Parse /proc/<pid>/stat (or task/<tid>/stat). Any of COMM, STATE,
+ * and PPID can be NULL. Returns false if it couldn't be read. */
+bool proc_parse_stat(const char *path, char *comm, size_t comm_size,
+    char *state, pid_t *ppid);
+
+/* Get the user + system CPU time PID has used so far, in msec. */
+bool proc_cpu_msec(pid_t pid, double *msec);
+
+bool proc_is_numeric(const char *s);
+
+/* Get every process's parent. */
+void proc_scan(struct proc_table *t);
+
+/* Get ROOT and all of its descendants in ALL, breadth-first, so the
+ * root comes first and descendants follow in order of depth. */
+void proc_tree(const struct proc_table *all, pid_t root, pid_t root_ppid,
+    struct proc_table *tree);
+
+void proc_table_free(struct proc_table *t);
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2015-18 Scott Vokes <vokes.s@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <err.h>
+
+#include "regress.h"
+
+#define BASELINE_HEADER "# autoclave baseline v1"
+
+/* Don't draw any conclusions before this many runs. */
+#define MIN_SAMPLES 10
+
+/* Significance levels for the checks after each run, and for the
+ * final check once the run limit is reached. */
+#define ALPHA_INTERIM 0.001
+#define ALPHA_FINAL 0.01
+
+void regress_load_baseline(struct regress *r, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) { err(1, "fopen: %s", path); }
+
+    /* Refuse anything that wasn't saved by -b, rather than comparing
+     * against whatever numbers happen to be in it. */
+    char line[256];
+    size_t line_no = 1;
+    if (fgets(line, sizeof(line), f) == NULL
+        || 0 != strncmp(line, BASELINE_HEADER "\n", sizeof(line))) {
+        errx(1, "%s: not an autoclave baseline (v1)", path);
+    }
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+        if (line[0] == '#' || line[0] == '\n') { continue; }
+        double wall, cpu;
+        if (2 != sscanf(line, "%lf %lf", &wall, &cpu)) {
+            errx(1, "%s:%zu: malformed baseline sample", path, line_no);
+        }
+        samples_push(&r->base_wall, wall);
+        samples_push(&r->base_cpu, cpu);
+    }
+    if (ferror(f)) { err(1, "fgets: %s", path); }
+    fclose(f);
+
+    if (r->base_wall.count == 0) {
+        errx(1, "%s: baseline has no samples", path);
+    }
+    samples_sort(&r->base_wall);
+    samples_sort(&r->base_cpu);
+    r->have_baseline = true;
+}
+
+void regress_add(struct regress *r, double wall_msec, double cpu_msec) {
+    samples_push(&r->wall, wall_msec);
+    samples_push(&r->cpu, cpu_msec);
+    if (r->have_baseline) {
+        samples_insert_sorted(&r->sorted_wall, wall_msec);
+        samples_insert_sorted(&r->sorted_cpu, cpu_msec);
+    }
+}
+
+static const struct samples *current(const struct regress *r) {
+    return r->metric == REGRESS_CPU ? &r->cpu : &r->wall;
+}
+
+static const struct samples *baseline(const struct regress *r) {
+    return r->metric == REGRESS_CPU ? &r->base_cpu : &r->base_wall;
+}
+
+enum regress_verdict regress_check(struct regress *r, bool final) {
+    const struct samples *cur = current(r);
+    if (!r->have_baseline || cur->count == 0) { return REGRESS_UNDECIDED; }
+    if (!final && cur->count < MIN_SAMPLES) { return REGRESS_UNDECIDED; }
+
+    /* Test the current runs against the baseline scaled up by the
+     * threshold, so "slower" means "slower by more than that". */
+    struct mann_whitney mw;
+    stats_mann_whitney(r->metric == REGRESS_CPU
+        ? &r->sorted_cpu : &r->sorted_wall, baseline(r),
+        1.0 + r->threshold_pct / 100.0, &mw);
+    r->p_slower = mw.p_greater;
+    r->p_not_slower = mw.p_less;
+
+    const double alpha = final ? ALPHA_FINAL : ALPHA_INTERIM;
+    if (mw.p_greater < alpha) {
+        r->verdict = REGRESS_SLOWER;
+    } else if (mw.p_less < alpha) {
+        r->verdict = REGRESS_NOT_SLOWER;
+    } else {
+        r->verdict = REGRESS_UNDECIDED;
+    }
+    return r->verdict;
+}
+
+static double pct_change(double base, double cur) {
+    return base == 0 ? 0 : 100.0 * (cur - base) / base;
+}
+
+void regress_report(const struct regress *r, FILE *out) {
+    if (!r->have_baseline) { return; }
+    const struct samples *cur = current(r);
+    const struct samples *base = baseline(r);
+    const double b50 = samples_percentile(base, 50);
+    const double b95 = samples_percentile(base, 95);
+    const double c50 = samples_percentile(cur, 50);
+    const double c95 = samples_percentile(cur, 95);
+
+    fprintf(out, "-- regression check (%s msec, threshold %g%%):\n",
+        r->metric == REGRESS_CPU ? "cpu" : "wall", r->threshold_pct);
+    fprintf(out, "--   baseline: %zu runs, median %g, p95 %g\n",
+        base->count, b50, b95);
+    fprintf(out, "--   current:  %zu runs, median %g (%+.1f%%), "
+        "p95 %g (%+.1f%%)\n", cur->count,
+        c50, pct_change(b50, c50), c95, pct_change(b95, c95));
+
+    const char *verdict = "inconclusive";
+    if (r->verdict == REGRESS_SLOWER) {
+        verdict = "SLOWER";
+    } else if (r->verdict == REGRESS_NOT_SLOWER) {
+        verdict = "not slower";
+    }
+    fprintf(out, "--   p(slower) = %.4g, p(not slower) = %.4g: %s\n",
+        r->p_slower, r->p_not_slower, verdict);
+}
+
+void regress_save(const struct regress *r, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) { err(1, "fopen: %s", path); }
+    fprintf(f, "%s\n# wall_msec cpu_msec\n", BASELINE_HEADER);
+    for (size_t i = 0; i < r->wall.count; i++) {
+        fprintf(f, "%.6f %.6f\n", r->wall.v[i], r->cpu.v[i]);
+    }
+    if (0 != fclose(f)) { err(1, "fclose: %s", path); }
+}
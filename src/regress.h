@@ -0,0 +1,56 @@
+#ifndef REGRESS_H
+#define REGRESS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "stats.h"
+
+/* Performance regression detection: collect per-run durations,
+ * optionally save them as a baseline, and compare them against a
+ * previously saved baseline. */
+
+enum regress_metric {
+    REGRESS_WALL,               /* wall-clock msec */
+    REGRESS_CPU,                /* user + system CPU msec */
+};
+
+enum regress_verdict {
+    REGRESS_UNDECIDED,
+    REGRESS_SLOWER,             /* slower by more than the threshold */
+    REGRESS_NOT_SLOWER,         /* not slower by more than the threshold */
+};
+
+struct regress {
+    enum regress_metric metric;
+    double threshold_pct;
+    struct samples wall;        /* in run order, for saving */
+    struct samples cpu;
+    struct samples sorted_wall; /* the same, sorted, for comparing */
+    struct samples sorted_cpu;
+    struct samples base_wall;   /* sorted once loaded */
+    struct samples base_cpu;
+    bool have_baseline;
+    enum regress_verdict verdict;
+    double p_slower;
+    double p_not_slower;
+};
+
+/* Load a baseline saved by regress_save. Exits via err(3) if it
+ * cannot be read or contains no samples. */
+void regress_load_baseline(struct regress *r, const char *path);
+
+void regress_add(struct regress *r, double wall_msec, double cpu_msec);
+
+/* Check whether the runs so far are conclusively slower than the
+ * baseline, or conclusively not. Earlier checks use a stricter
+ * significance level, since checking after every run would otherwise
+ * inflate the false positive rate. FINAL is set for the last check. */
+enum regress_verdict regress_check(struct regress *r, bool final);
+
+void regress_report(const struct regress *r, FILE *out);
+
+/* Save the durations collected so far as a baseline. */
+void regress_save(const struct regress *r, const char *path);
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2015-18 Scott Vokes <vokes.s@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+
+#include "sample.h"
+#include "proc.h"
+
+bool sample_supported(void) {
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+void sample_reset(struct sample_series *ser) {
+    ser->count = 0;
+}
+
+static struct proc_sample *next_sample(struct sample_series *ser) {
+    if (ser->count == ser->ceil) {
+        const size_t nceil = ser->ceil == 0 ? 64 : 2 * ser->ceil;
+        struct proc_sample *ns = realloc(ser->s, nceil * sizeof(*ns));
+        if (ns == NULL) { err(1, "realloc"); }
+        ser->s = ns;
+        ser->ceil = nceil;
+    }
+    struct proc_sample *res = &ser->s[ser->count++];
+    memset(res, 0, sizeof(*res));
+    return res;
+}
+
+static size_t count_fds(pid_t pid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/fd", (int)pid);
+    DIR *d = opendir(path);
+    if (d == NULL) { return 0; }
+    size_t count = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (proc_is_numeric(de->d_name)) { count++; }
+    }
+    closedir(d);
+    return count;
+}
+
+/* Add one process's usage to SAMPLE. */
+static bool add_proc(struct proc_sample *sample, pid_t pid) {
+    char path[64];
+    char buf[1024];
+
+    /* utime and stime are fields 14 and 15, num_threads is 20. */
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    if (proc_read_file(path, buf, sizeof(buf)) <= 0) { return false; }
+    const char *close_paren = strrchr(buf, ')');
+    unsigned long utime, stime;
+    long threads;
+    if (close_paren == NULL || 3 != sscanf(close_paren + 1,
+            " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu"
+            " %*d %*d %*d %*d %ld", &utime, &stime, &threads)) {
+        return false;
+    }
+
+    /* statm's second field is the resident set size, in pages. */
+    unsigned long resident = 0;
+    snprintf(path, sizeof(path), "/proc/%d/statm", (int)pid);
+    if (proc_read_file(path, buf, sizeof(buf)) > 0) {
+        (void)sscanf(buf, "%*u %lu", &resident);
+    }
+
+    /* rchar and wchar count all bytes read and written, whether or
+     * not they went to storage. Unreadable without ptrace access. */
+    unsigned long long rchar = 0, wchar = 0;
+    snprintf(path, sizeof(path), "/proc/%d/io", (int)pid);
+    if (proc_read_file(path, buf, sizeof(buf)) > 0) {
+        (void)sscanf(buf, "rchar: %llu wchar: %llu", &rchar, &wchar);
+    }
+
+    sample->procs++;
+    sample->threads += threads;
+    sample->fds += count_fds(pid);
+    sample->rss_kb += (uint64_t)resident * (sysconf(_SC_PAGESIZE) / 1024);
+    sample->cpu_ticks += utime + stime;
+    sample->read_bytes += rchar;
+    sample->write_bytes += wchar;
+    errno = 0;
+    return true;
+}
+
+bool sample_take(struct sample_series *ser, pid_t pid, bool descendants,
+    uint32_t msec) {
+    if (!sample_supported()) { return false; }
+    struct proc_sample *sample = next_sample(ser);
+    sample->msec = msec;
+
+    bool ok = add_proc(sample, pid);
+    if (ok && descendants) {
+        static struct proc_table all, tree;
+        proc_scan(&all);
+        proc_tree(&all, pid, 0, &tree);
+        for (size_t i = 1; i < tree.count; i++) {
+            (void)add_proc(sample, tree.entries[i].pid);
+        }
+    }
+
+    if (!ok) { ser->count--; }
+    return ok;
+}
+
+static double metric(const struct proc_sample *s, int which) {
+    return which == GROWTH_RSS ? (double)s->rss_kb : (double)s->fds;
+}
+
+/* A value grows steadily if the mean of each quarter of the run is
+ * higher than the last, and the total growth is at least MIN_DELTA.
+ * This ignores spikes, and growth that levels off once warmed up. */
+static bool grows(const struct sample_series *ser, int which,
+    double min_delta) {
+    double means[4];
+    const size_t n = ser->count;
+    for (int q = 0; q < 4; q++) {
+        const size_t from = q * n / 4;
+        const size_t to = (q + 1) * n / 4;
+        double sum = 0;
+        for (size_t i = from; i < to; i++) {
+            sum += metric(&ser->s[i], which);
+        }
+        means[q] = sum / (to - from);
+    }
+    return means[0] < means[1] && means[1] < means[2]
+        && means[2] < means[3] && means[3] - means[0] >= min_delta;
+}
+
+int sample_growth(const struct sample_series *ser) {
+    if (ser->count < GROWTH_MIN_SAMPLES) { return 0; }
+    int res = 0;
+    if (grows(ser, GROWTH_RSS, GROWTH_MIN_RSS_KB)) { res |= GROWTH_RSS; }
+    if (grows(ser, GROWTH_FDS, GROWTH_MIN_FDS)) { res |= GROWTH_FDS; }
+    return res;
+}
+
+bool sample_write(const struct sample_series *ser, const char *path,
+    pid_t pid, size_t run_id, int growth) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        warn("fopen: %s", path);
+        return false;
+    }
+    fprintf(f, "# autoclave samples: run %zu, pid %d, %ld ticks/sec%s%s\n",
+        run_id, (int)pid, sysconf(_SC_CLK_TCK),
+        (growth & GROWTH_RSS) ? ", RSS growing" : "",
+        (growth & GROWTH_FDS) ? ", fds growing" : "");
+    fprintf(f, "# msec\tprocs\tthreads\tfds\trss_kb\tcpu_ticks"
+        "\tread_bytes\twrite_bytes\n");
+    for (size_t i = 0; i < ser->count; i++) {
+        const struct proc_sample *s = &ser->s[i];
+        fprintf(f, "%u\t%u\t%u\t%u\t%llu\t%llu\t%llu\t%llu\n",
+            s->msec, s->procs, s->threads, s->fds,
+            (unsigned long long)s->rss_kb,
+            (unsigned long long)s->cpu_ticks,
+            (unsigned long long)s->read_bytes,
+            (unsigned long long)s->write_bytes);
+    }
+    if (0 != fclose(f)) {
+        warn("fclose: %s", path);
+        return false;
+    }
+    return true;
+}
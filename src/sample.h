@@ -0,0 +1,60 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Periodic sampling of a child's resource usage from /proc, so leaks
+ * and spikes partway through a run can be seen. (Linux only.) */
+
+struct proc_sample {
+    uint32_t msec;              /* since the run started */
+    uint32_t procs;             /* processes included */
+    uint32_t threads;
+    uint32_t fds;
+    uint64_t rss_kb;
+    uint64_t cpu_ticks;         /* user + system, in clock ticks */
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+};
+
+struct sample_series {
+    size_t count;
+    size_t ceil;
+    struct proc_sample *s;
+};
+
+/* Flags for sample_growth. */
+#define GROWTH_RSS 0x01
+#define GROWTH_FDS 0x02
+
+/* Don't look for growth in runs with fewer samples than this. */
+#define GROWTH_MIN_SAMPLES 8
+
+/* Minimum growth, between the first and last quarters of the run,
+ * before it is flagged. */
+#define GROWTH_MIN_RSS_KB 1024
+#define GROWTH_MIN_FDS 2
+
+/* Whether sampling is supported on this platform. */
+bool sample_supported(void);
+
+void sample_reset(struct sample_series *ser);
+
+/* Sample PID (and, if DESCENDANTS, all of its descendants, summed)
+ * and append it to SER. Returns false if PID couldn't be read. */
+bool sample_take(struct sample_series *ser, pid_t pid, bool descendants,
+    uint32_t msec);
+
+/* Check whether RSS or the open fd count grew steadily over the run.
+ * Returns a bitmask of GROWTH_* flags. */
+int sample_growth(const struct sample_series *ser);
+
+/* Write the series to PATH as tab-separated values.
+ * Returns false (after printing a warning) on failure. */
+bool sample_write(const struct sample_series *ser, const char *path,
+    pid_t pid, size_t run_id, int growth);
+
+#endif
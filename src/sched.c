@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2015-18 Scott Vokes <vokes.s@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <math.h>
+
+#include "sched.h"
+
+/* How much each earlier run/failure still counts, per later run of
+ * the same target. 0.95 means failures fade out after ~50 runs. */
+#define DECAY 0.95
+
+/* Weight of the exploration bonus. Failure rates in stress tests are
+ * usually small, so the UCB1 default of sqrt(2) would swamp them. */
+#define EXPLORE 0.25
+
+/* Prior pseudo-counts, so a target that failed once in its first
+ * run doesn't get a failure rate of 100%. */
+#define PRIOR_FAILURES 0.5
+#define PRIOR_RUNS 2.0
+
+double sched_failure_rate(const struct sched_arm *arm) {
+    return (arm->decayed_failures + PRIOR_FAILURES)
+        / (arm->decayed_runs + PRIOR_RUNS);
+}
+
+size_t sched_pick(const struct sched_arm *arms, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) { total += arms[i].runs; }
+
+    /* First, make sure every arm has run at least once, and has
+     * had its minimum share. Ties go to the lowest index. */
+    const double min_runs = SCHED_MIN_SHARE * total / count;
+    size_t starved = count;
+    for (size_t i = 0; i < count; i++) {
+        if (arms[i].runs == 0 || arms[i].runs < min_runs) {
+            if (starved == count || arms[i].runs < arms[starved].runs) {
+                starved = i;
+            }
+        }
+    }
+    if (starved != count) { return starved; }
+
+    /* Otherwise, UCB1: recent failure rate plus an exploration bonus
+     * that grows for arms that haven't run in a while. */
+    size_t best = 0;
+    double best_score = -1;
+    for (size_t i = 0; i < count; i++) {
+        const double bonus = EXPLORE
+            * sqrt(2.0 * log((double)total) / arms[i].runs);
+        const double score = sched_failure_rate(&arms[i]) + bonus;
+        if (score > best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+void sched_update(struct sched_arm *arm, bool failed) {
+    arm->runs++;
+    arm->decayed_runs = DECAY * arm->decayed_runs + 1;
+    arm->decayed_failures = DECAY * arm->decayed_failures + (failed ? 1 : 0);
+}
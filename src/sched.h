@@ -0,0 +1,31 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Scheduling between several targets sharing one run budget (-j).
+ * Each target is treated as an arm of a multi-armed bandit, with
+ * failures as the reward: targets that have failed recently get more
+ * runs, targets with few runs get explored, and every target is
+ * guaranteed a minimum share of the runs. */
+
+struct sched_arm {
+    size_t runs;
+    double decayed_runs;        /* recent runs, exponentially decayed */
+    double decayed_failures;    /* recent failures, likewise */
+};
+
+/* Each target gets at least this fraction of an equal share. */
+#define SCHED_MIN_SHARE 0.5
+
+/* Pick the index of the arm to run next, out of COUNT. */
+size_t sched_pick(const struct sched_arm *arms, size_t count);
+
+/* Update an arm after one of its runs. */
+void sched_update(struct sched_arm *arm, bool failed);
+
+/* The arm's recent failure rate, as used for scheduling. */
+double sched_failure_rate(const struct sched_arm *arm);
+
+#endif
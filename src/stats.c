@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2015-18 Scott Vokes <vokes.s@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <err.h>
+
+#include "stats.h"
+
+void samples_push(struct samples *s, double v) {
+    if (s->count == s->ceil) {
+        const size_t nceil = s->ceil == 0 ? 64 : 2 * s->ceil;
+        double *nv = realloc(s->v, nceil * sizeof(double));
+        if (nv == NULL) { err(1, "realloc"); }
+        s->v = nv;
+        s->ceil = nceil;
+    }
+    s->v[s->count++] = v;
+}
+
+void samples_free(struct samples *s) {
+    free(s->v);
+    s->v = NULL;
+    s->count = 0;
+    s->ceil = 0;
+}
+
+static int cmp_double(const void *pa, const void *pb) {
+    const double a = *(const double *)pa;
+    const double b = *(const double *)pb;
+    return a < b ? -1 : a > b ? 1 : 0;
+}
+
+void samples_sort(struct samples *s) {
+    if (s->count > 1) { qsort(s->v, s->count, sizeof(double), cmp_double); }
+}
+
+void samples_insert_sorted(struct samples *s, double v) {
+    samples_push(s, v);
+
+    /* Find the first element greater than V, and shift the rest up. */
+    size_t lo = 0, hi = s->count - 1;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (s->v[mid] <= v) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    memmove(&s->v[lo + 1], &s->v[lo],
+        (s->count - 1 - lo) * sizeof(double));
+    s->v[lo] = v;
+}
+
+double samples_percentile(const struct samples *s, double p) {
+    if (s->count == 0) { return 0; }
+    double *sorted = malloc(s->count * sizeof(double));
+    if (sorted == NULL) { err(1, "malloc"); }
+    memcpy(sorted, s->v, s->count * sizeof(double));
+    qsort(sorted, s->count, sizeof(double), cmp_double);
+
+    const double rank = (p / 100.0) * (s->count - 1);
+    const size_t lo = (size_t)rank;
+    const size_t hi = lo + 1 < s->count ? lo + 1 : lo;
+    const double frac = rank - lo;
+    const double res = sorted[lo] + frac * (sorted[hi] - sorted[lo]);
+    free(sorted);
+    return res;
+}
+
+void stats_mann_whitney(const struct samples *a,
+    const struct samples *b, double b_scale,
+    struct mann_whitney *res) {
+    const size_t na = a->count;
+    const size_t nb = b->count;
+    const size_t n = na + nb;
+    memset(res, 0, sizeof(*res));
+    res->p_greater = 1;
+    res->p_less = 1;
+    if (na == 0 || nb == 0) { return; }
+
+    /* Merge the sorted samples, summing A's ranks, giving tied values
+     * their average rank, and accumulate the tie correction term
+     * sum(t^3 - t). */
+    double rank_sum_a = 0;
+    double ties = 0;
+    size_t i = 0, j = 0;
+    while (i < na || j < nb) {
+        const double v = j == nb || (i < na && a->v[i] <= b_scale * b->v[j])
+          ? a->v[i] : b_scale * b->v[j];
+        const size_t first = i + j;
+        size_t ta = 0;
+        while (i < na && a->v[i] == v) { i++; ta++; }
+        while (j < nb && b_scale * b->v[j] == v) { j++; }
+        const double t = i + j - first;
+        const double avg_rank = first + (t + 1) / 2.0;
+        rank_sum_a += ta * avg_rank;
+        ties += t * t * t - t;
+    }
+
+    const double u = rank_sum_a - na * (na + 1) / 2.0;
+    const double mu = na * (double)nb / 2.0;
+    const double var = (na * (double)nb / 12.0)
+        * ((n + 1) - ties / ((double)n * (n - 1)));
+    res->u = u;
+    if (var <= 0) { return; }   /* all values tied */
+
+    const double sd = sqrt(var);
+    res->z = (u - mu) / sd;
+    /* One-sided tails, with a continuity correction of 0.5. */
+    res->p_greater = 0.5 * erfc(((u - mu - 0.5) / sd) / sqrt(2.0));
+    res->p_less = 0.5 * erfc(((mu - u - 0.5) / sd) / sqrt(2.0));
+}
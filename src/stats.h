@@ -0,0 +1,44 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+
+/* A growable array of measurements. */
+struct samples {
+    size_t count;
+    size_t ceil;
+    double *v;
+};
+
+void samples_push(struct samples *s, double v);
+void samples_free(struct samples *s);
+
+/* Sort S in ascending order, in place. */
+void samples_sort(struct samples *s);
+
+/* Add V to S, which must already be sorted, keeping it sorted. */
+void samples_insert_sorted(struct samples *s, double v);
+
+/* Get the P-th percentile (0 <= P <= 100) of S, interpolating
+ * between the closest ranks. Returns 0 if S is empty. */
+double samples_percentile(const struct samples *s, double p);
+
+/* Result of a Mann-Whitney U test of A against B, as a p-value for
+ * each one-sided alternative, using the normal approximation with
+ * tie correction. */
+struct mann_whitney {
+    double u;                   /* U statistic for A */
+    double z;                   /* standardized U */
+    double p_greater;           /* one-sided p: A tends to exceed B */
+    double p_less;              /* one-sided p: A tends to be below B */
+};
+
+/* Compare A against B, with every element of B first multiplied
+ * by B_SCALE (e.g. 1.05 to test for "more than 5% greater"). A and B
+ * must both be sorted. This merges them in one pass, without
+ * allocating, so it is cheap enough to call after every run. */
+void stats_mann_whitney(const struct samples *a,
+    const struct samples *b, double b_scale,
+    struct mann_whitney *res);
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2015-18 Scott Vokes <vokes.s@gmail.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <err.h>
+
+#include "trace.h"
+
+#define EVENTS_PER_CHUNK 512
+
+/* Flush once this many chunks are full. */
+#define FLUSH_CHUNKS 8
+
+enum event_type {
+    EV_SPAN,
+    EV_RUN,
+    EV_COUNTER,
+};
+
+struct trace_event {
+    enum event_type type;
+    bool failed;
+    const char *name;
+    const char *target;
+    uint64_t ts;
+    uint64_t dur;
+    size_t run_id;
+    double value;
+};
+
+struct trace_chunk {
+    struct trace_chunk *next;
+    size_t count;
+    struct trace_event events[EVENTS_PER_CHUNK];
+};
+
+struct trace {
+    FILE *out;
+    int pid;
+    size_t full_chunks;
+    struct trace_chunk *head;
+    struct trace_chunk *tail;
+    struct trace_chunk *free_list; /* written chunks, for reuse */
+};
+
+struct trace *trace_open(const char *path) {
+    struct trace *t = calloc(1, sizeof(*t));
+    if (t == NULL) { err(1, "calloc"); }
+    t->out = fopen(path, "w");
+    if (t->out == NULL) { err(1, "fopen: %s", path); }
+    t->pid = (int)getpid();
+    fprintf(t->out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(t->out,
+        "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"tid\":1,"
+        "\"args\":{\"name\":\"autoclave\"}},\n"
+        "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":1,"
+        "\"args\":{\"name\":\"supervisor\"}}",
+        t->pid, t->pid);
+    return t;
+}
+
+static struct trace_event *next_event(struct trace *t) {
+    if (t->tail == NULL || t->tail->count == EVENTS_PER_CHUNK) {
+        if (t->tail != NULL) { t->full_chunks++; }
+        struct trace_chunk *c = t->free_list;
+        if (c != NULL) {
+            t->free_list = c->next;
+        } else {
+            c = malloc(sizeof(*c));
+            if (c == NULL) { err(1, "malloc"); }
+        }
+        c->next = NULL;
+        c->count = 0;
+        if (t->tail == NULL) {
+            t->head = c;
+        } else {
+            t->tail->next = c;
+        }
+        t->tail = c;
+    }
+    return &t->tail->events[t->tail->count++];
+}
+
+void trace_span(struct trace *t, const char *name,
+    uint64_t start_usec, uint64_t end_usec,
+    size_t run_id, const char *target) {
+    struct trace_event *ev = next_event(t);
+    *ev = (struct trace_event){
+        .type = EV_SPAN,
+        .name = name,
+        .target = target,
+        .ts = start_usec,
+        .dur = end_usec > start_usec ? end_usec - start_usec : 0,
+        .run_id = run_id,
+    };
+}
+
+void trace_run(struct trace *t, uint64_t start_usec, uint64_t end_usec,
+    size_t run_id, const char *target, bool failed) {
+    trace_span(t, "run", start_usec, end_usec, run_id, target);
+    t->tail->events[t->tail->count - 1].type = EV_RUN;
+    t->tail->events[t->tail->count - 1].failed = failed;
+}
+
+void trace_counter(struct trace *t, const char *name,
+    uint64_t ts_usec, double value) {
+    struct trace_event *ev = next_event(t);
+    *ev = (struct trace_event){
+        .type = EV_COUNTER,
+        .name = name,
+        .ts = ts_usec,
+        .value = value,
+    };
+}
+
+/* Target names come from job files, so escape them for JSON. */
+static void write_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        const unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void write_event(struct trace *t, const struct trace_event *ev) {
+    FILE *out = t->out;
+    fprintf(out, ",\n{\"pid\":%d,\"tid\":1,\"ts\":%llu,\"name\":",
+        t->pid, (unsigned long long)ev->ts);
+    write_string(out, ev->name);
+
+    if (ev->type == EV_COUNTER) {
+        fprintf(out, ",\"ph\":\"C\",\"args\":{\"value\":%g}}", ev->value);
+        return;
+    }
+
+    fprintf(out, ",\"ph\":\"X\",\"cat\":\"%s\",\"dur\":%llu,"
+        "\"args\":{\"run_id\":%zu",
+        ev->type == EV_RUN ? "run" : "phase",
+        (unsigned long long)ev->dur, ev->run_id);
+    if (ev->target != NULL) {
+        fprintf(out, ",\"target\":");
+        write_string(out, ev->target);
+    }
+    if (ev->type == EV_RUN) {
+        fprintf(out, ",\"failed\":%s", ev->failed ? "true" : "false");
+    }
+    fprintf(out, "}}");
+}
+
+static void flush_all(struct trace *t) {
+    struct trace_chunk *c = t->head;
+    while (c != NULL) {
+        for (size_t i = 0; i < c->count; i++) {
+            write_event(t, &c->events[i]);
+        }
+        struct trace_chunk *next = c->next;
+        c->next = t->free_list;
+        t->free_list = c;
+        c = next;
+    }
+    t->head = NULL;
+    t->tail = NULL;
+    t->full_chunks = 0;
+    if (0 != fflush(t->out)) { err(1, "fflush"); }
+}
+
+bool trace_maybe_flush(struct trace *t) {
+    if (t->full_chunks < FLUSH_CHUNKS) { return false; }
+    flush_all(t);
+    return true;
+}
+
+void trace_close(struct trace *t) {
+    if (t == NULL) { return; }
+
+    /* Only the process that opened the trace may finish it; a forked
+     * copy would append its stale buffer and a second terminator. */
+    if ((int)getpid() != t->pid) { return; }
+    flush_all(t);
+    fprintf(t->out, "\n]}\n");
+    if (0 != fclose(t->out)) { err(1, "fclose"); }
+
+    struct trace_chunk *c = t->free_list;
+    while (c != NULL) {
+        struct trace_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    free(t);
+}
@@ -0,0 +1,40 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Export of the campaign's timeline as Chrome trace-event JSON, for
+ * viewing in Perfetto or chrome://tracing. Events are buffered in
+ * memory in fixed-size chunks, and written out in batches between
+ * runs, so tracing doesn't distort the timings it records. */
+struct trace;
+
+/* Open a trace file at PATH. Exits via err(3) on failure. */
+struct trace *trace_open(const char *path);
+
+/* Record a complete span. NAME must be a string constant; TARGET
+ * (which may be NULL) must outlive the trace. */
+void trace_span(struct trace *t, const char *name,
+    uint64_t start_usec, uint64_t end_usec,
+    size_t run_id, const char *target);
+
+/* Same as trace_span, but also note whether the run failed. */
+void trace_run(struct trace *t, uint64_t start_usec, uint64_t end_usec,
+    size_t run_id, const char *target, bool failed);
+
+/* Record a counter track's value. NAME must be a string constant. */
+void trace_counter(struct trace *t, const char *name,
+    uint64_t ts_usec, double value);
+
+/* Write out buffered events if enough chunks have filled up.
+ * Returns true if anything was written. */
+bool trace_maybe_flush(struct trace *t);
+
+/* Write out everything buffered, terminate the JSON, and close.
+ * Does nothing if called from a process other than the one that
+ * opened the trace. */
+void trace_close(struct trace *t);
+
+#endif
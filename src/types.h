@@ -28,6 +28,35 @@ struct rotation {
 #define DEF_KILL_SIGNAL SIGINT
 #define NO_TIMEOUT (-1)
 #define NO_LIMIT ((size_t)(-1))
+#define DEF_REGRESS_THRESHOLD_PCT 5.0
+#define DEF_REGRESS_RUN_FACTOR 4
+#define DEF_SAMPLE_MSEC 100
+
+/* A command line to run repeatedly, with its own settings. Normally
+ * there is one, from autoclave's command line; -j reads several from
+ * a job file. Settings not given in the job file come from the config. */
+struct target {
+    char *name;
+    int argc;
+    char **argv;
+    int timeout_sec;
+    uint64_t ignored_exits[256/64];
+    char *output_prefix;
+};
+
+/* Per-target counters. */
+struct target_state {
+    size_t runs;
+    size_t failures;
+    double total_msec;
+
+    /* Run IDs of the most recent passing-log candidates, for rotating
+     * by count when run IDs are not contiguous (shared campaigns, or
+     * several targets). */
+    size_t *rot_ring;
+    size_t rot_pos;
+    size_t rot_len;
+};
 
 struct config {
     size_t max_failures;
@@ -41,17 +70,54 @@ struct config {
     int verbosity;
     char *error_handler;
     char *run_id_str;
+    char *campaign_path;
+    char *job_path;
+    char *trace_path;
+    size_t sample_msec;         /* 0: no sampling */
+    bool sample_descendants;
+    bool flag_growth;
+    bool perf_counters;
+    size_t iterations;          /* per exec, with -N; 0: one run per exec */
+    bool compress_logs;
     int timeout_kill_signal;
+    int hang_detail;            /* enum hang_detail */
+    char *baseline_path;
+    char *baseline_save_path;
+    double regress_threshold_pct;
+    int regress_metric;         /* enum regress_metric */
     uint64_t ignored_exits[256/64];
 
     int argc;
     char **argv;
+
+    size_t target_count;
+    struct target *targets;
 };
 
+struct campaign;
+struct regress;
+struct sched_arm;
+struct trace;
+struct sample_series;
+struct perf;
+struct iter_batch;
+struct compressor;
+
 struct state {
     struct timeval start_time;
-    size_t run_id;
+    size_t run_id;              /* ID of the current run */
+    size_t runs;                /* runs started by this instance */
     size_t failures;
+    struct campaign *campaign;  /* shared campaign, if any (-S) */
+    struct regress *regress;    /* performance baseline, if any (-b/-B) */
+    struct target_state *targets;
+    struct sched_arm *arms;     /* for scheduling between targets (-j) */
+    struct trace *trace;        /* timeline export, if any (-T) */
+    struct sample_series *samples; /* current run's samples, if any (-P) */
+    size_t flagged;             /* runs flagged for resource growth */
+    struct perf *perf;          /* perf_event counters, if any (-E) */
+    struct iter_batch *batch;   /* iteration protocol state, if -N */
+    struct compressor *compress; /* log compression worker, if -z */
 };
 
 struct child_status {
@@ -62,6 +128,18 @@ struct child_status {
     uint8_t exit_status;
     uint8_t term_signal;
     uint8_t stop_signal;
+    double cpu_msec;
+    int growth;                 /* GROWTH_* flags, if sampled */
+    char report;                /* -N: the iteration's reported result */
+    double iter_msec;           /* -N: its duration, if it reported one */
+};
+
+/* Files to pass to the error handler, or NULL. */
+struct run_paths {
+    const char *stdout_log;
+    const char *stderr_log;
+    const char *hang;
+    const char *samples;
 };
 
 enum log_status {
@@ -71,22 +149,69 @@ enum log_status {
 };
 
 static void handle_args(struct config *cfg, int argc, char **argv);
+static char *copy_str(const char *str);
+static void add_target(struct config *cfg, const struct target *t);
+static void read_job_file(struct config *cfg, const char *path);
+static void init_output_prefix(const struct config *cfg, struct target *t);
 static void sigchild_handler(int sig);
+static void sigpipe_handler(int sig);
 static int log_path(char *buf, size_t buf_size,
     size_t id, const char *fdname,
     enum log_status status);
-static bool try_exec(size_t id, struct child_status *status);
+static int output_path(char *buf, size_t buf_size,
+    size_t id, const char *name, const char *ext,
+    enum log_status status);
+static bool try_exec(struct target_state *ts, size_t id,
+    struct child_status *status);
+static int open_log(char *buf, size_t id, const char *tag);
+static pid_t spawn_child(int outlog, int errlog,
+    int control_fd, int report_fd);
+static bool check_status(struct child_status *status, int stat_loc,
+    bool timed_out);
+static void handle_failure(struct child_status *status, bool failed,
+    bool timed_out, const struct run_paths *logs);
+static void finish_logs(struct target_state *ts, size_t id,
+    int outlog, int errlog, bool failed);
+static void set_cloexec(int fd);
+static void start_batch(struct iter_batch *b, size_t id);
+static void close_control(struct iter_batch *b);
+static void end_batch(struct target_state *ts, struct iter_batch *b);
+static bool try_iteration(struct target_state *ts, size_t id,
+    struct child_status *status);
+static void stop_batch(void);
+static void abandon_run(pid_t pid, bool exited);
+static bool read_reports(struct iter_batch *b, struct child_status *status);
 static int supervise_process(struct child_status *status,
-    bool *timed_out);
+    bool *timed_out, bool *exited);
 static void setenv_and_call_handler(struct child_status *status,
-    char *stdout_log_path, char *stderr_log_path);
+    const struct run_paths *paths);
 static int mainloop(void);
 static void init_sigchild_alert(void);
 static void init_sigint_handler(void);
+static void init_sigpipe_handler(void);
 static void print_stats(void);
+static void cur_time(struct timeval *tv);
+static double calc_duration(const struct timeval *pre,
+    const struct timeval *post);
+
+static uint64_t trace_now(void);
+static void trace_phase(const char *name, uint64_t start_usec);
+static void trace_end_run(uint64_t start_usec, bool failed);
+static void close_trace(void);
 
+struct rusage;
+static double child_cpu_msec(const struct rusage *pre);
 static void close_log(int fd);
 static void rename_log(const char *tag, size_t id, bool failed);
-static void rotate_log(const char *tag, size_t id);
+static bool rotation_push(struct target_state *ts, size_t id,
+    size_t *old_id);
+static void rotate_log(const char *tag, size_t old_id);
+static bool next_run_id(size_t *id);
+static size_t pick_target(void);
+static bool record_run(bool failed);
+static int exit_status(void);
+static void finish_regress(void);
+static void close_compress(void);
+static void close_campaign(void);
 
 #endif